@@ -4,11 +4,18 @@
 static int topbar  = 1; /* -b  option; if 0, dmenu appears at bottom */
 static int opacity = 0; /* -o  option; if 0, then alpha is disabled */
 static int fuzzy   = 1; /* -F  option; if 0, dmenu doesn't use fuzzy matching */
+static int typos   = 0; /* -T  option; if 1, items a few typos off are listed
+			   after the matches */
+static unsigned int typo_threshold = 3; /* only look for typos when fewer items
+					   match */
+static unsigned int typo_ratio     = 4; /* allow one typo per this many input
+					   characters */
 static int instant = 0; /* -n  option; if 1, selects matching item without the
 			   need to press enter */
 static int center
     = 1; /* -c  option; if 0, dmenu won't be centered on the screen */
 static int min_width     = 500; /* minimum width when centered */
+static int hover         = 1;   /* if 1, the item under the pointer is highlighted */
 static const int vertpad = 10;  /* vertical padding of bar */
 static const int sidepad = 10;  /* horizontal padding of bar */
 /* -fn option overrides fonts[0]; default X11 font or font set */
@@ -12,6 +12,17 @@ X11LIB = /usr/X11R6/lib
 XINERAMALIBS  = -lXinerama
 XINERAMAFLAGS = -DXINERAMA
 
+# MIT-SHM client side rendering, uncomment if you want it
+#SHMLIBS  = -lXext -lfreetype
+#SHMFLAGS = -DSHM
+
+# XCB for setup queries that share round-trips, uncomment if you want it
+#XCBLIBS  = -lX11-xcb -lxcb
+#XCBFLAGS = -DXCB
+
+# startup timing on stderr, uncomment if you want it
+#TIMINGFLAGS = -DTIMING
+
 # freetype
 FREETYPELIBS = -lfontconfig -lXft
 FREETYPEINC = /usr/include/freetype2
@@ -31,12 +42,12 @@ XRENDER = -lXrender
 
 # includes and libs
 INCS = -I$(X11INC) -I$(FREETYPEINC) ${PANGOINC}
-LIBS = -L$(X11LIB) -lX11 $(XINERAMALIBS) $(FREETYPELIBS) -lm $(XRENDER) ${PANGOLIB}
+LIBS = -L$(X11LIB) -lX11 $(XINERAMALIBS) $(FREETYPELIBS) -lm $(XRENDER) ${PANGOLIB} $(SHMLIBS) $(XCBLIBS)
 
 # flags
-CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_XOPEN_SOURCE=700 -D_POSIX_C_SOURCE=200809L -DVERSION=\"$(VERSION)\" $(XINERAMAFLAGS) $(EXTRAFLAGS)
-CFLAGS   = -std=c99 -pedantic -Wall -Os $(INCS) $(CPPFLAGS)
-LDFLAGS  = $(LIBS)
+CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_XOPEN_SOURCE=700 -D_POSIX_C_SOURCE=200809L -DVERSION=\"$(VERSION)\" $(XINERAMAFLAGS) $(SHMFLAGS) $(XCBFLAGS) $(TIMINGFLAGS) $(EXTRAFLAGS)
+CFLAGS   = -std=c99 -pedantic -Wall -Os -pthread $(INCS) $(CPPFLAGS)
+LDFLAGS  = -pthread $(LIBS)
 
 # compiler and linker
 CC = cc
@@ -1,6 +1,10 @@
 /* See LICENSE file for copyright and license details. */
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <locale.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +15,9 @@
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #include <X11/Xutil.h>
+#ifdef XCB
+#include <X11/Xlib-xcb.h>
+#endif
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif
@@ -57,8 +64,16 @@ struct item {
 	struct item *left, *right;
 	int id; /* for multiselect */
 	int hp;
+	int weight; /* producer supplied rank, see -rw */
 	double distance;
 	int index;
+	unsigned int mstart, mlen; /* byte range matched against, see -nth */
+	unsigned int chars; /* character classes present, for the typo tier */
+	unsigned long long bounds; /* word starts among the first 64 matched bytes */
+	unsigned char style; /* scheme of the icon, see itemstyle() */
+	unsigned char off, seloff; /* markup bytes before the shown text */
+	unsigned char icon; /* icon bytes at text + 3 */
+	size_t pos; /* index in matchv while matched */
 };
 
 static char text[BUFSIZ] = "";
@@ -76,7 +91,10 @@ static int vp; /* vertical padding for bar */
 static int sp; /* side padding for bar */
 static size_t cursor;
 static struct item *items = NULL;
+static size_t nitems;
 static struct item *matches, *matchend;
+static struct item **matchv; /* the match list as an array, see matchindex() */
+static size_t nmatches, matchvsize;
 static struct item *prev, *curr, *next, *sel;
 static int mon = -1, screen;
 static int print_index = 0;
@@ -87,9 +105,11 @@ static unsigned int sortmatches = 1;
 static unsigned int preselected = 0;
 static int commented = 0;
 static int animated = 0;
+static XWindowAttributes parentwa; /* read in main() */
+static int pendingmatch = 0, pendingdraw = 0; /* deferred to the end of a batch of events */
 
 static Atom clip, utf8;
-static Atom type, dock;
+static Atom type, dock, netwmname;
 static Display *dpy;
 static Window root, parentwin, win;
 static XIC xic;
@@ -123,9 +143,12 @@ static void cleanup(void);
 static char * cistrstr(const char *s, const char *sub);
 static int drawitem(struct item *item, int x, int y, int w);
 static void drawmenu(void);
+static void itemstyle(struct item *item);
 static void grabfocus(void);
 static void grabkeyboard(void);
 static void match(void);
+static void matchindex(void);
+static void flushmatch(void);
 static void insert(const char *str, ssize_t n);
 static size_t nextrune(int inc);
 static void movewordedge(int dir);
@@ -152,29 +175,67 @@ appenditem(struct item *item, struct item **list, struct item **last)
 	*last = item;
 }
 
+/* items on a page of the grid, or the width of the horizontal list */
+static int
+pagesize(void)
+{
+	if (lines > 0)
+		return lines * (columns ? columns : 1);
+	return mw - (promptw + inputw + TEXTW("<") + TEXTW(">") + TEXTW(numbers));
+}
+
 static void
 calcoffsets(void)
 {
-	int i, n, rpad = 0;
+	int i, n = pagesize();
 
+	/* calculate which items will begin the next page and previous page */
 	if (lines > 0) {
-		if (columns)
-			n = lines * columns * bh;
-		else
-			n = lines * bh;
-	} else {
-		rpad = TEXTW(numbers);
-		n = mw - (promptw + inputw + TEXTW("<") + TEXTW(">") + rpad);
+		next = curr && curr->pos + n < nmatches ? matchv[curr->pos + n] : NULL;
+		prev = curr ? matchv[curr->pos > (size_t)n ? curr->pos - n : 0] : NULL;
+		return;
 	}
-	/* calculate which items will begin the next page and previous page */
 	for (i = 0, next = curr; next; next = next->right)
-		if ((i += (lines > 0) ? bh : textw_clamp(next->text, n)) > n)
+		if ((i += itemw_clamp(next, n)) > n)
 			break;
 	for (i = 0, prev = curr; prev && prev->left; prev = prev->left)
-		if ((i += (lines > 0) ? bh : textw_clamp(prev->left->text, n)) > n)
+		if ((i += itemw_clamp(prev->left, n)) > n)
 			break;
 }
 
+/* first item of the page ending with the last match */
+static struct item *
+lastpage(void)
+{
+	struct item *item;
+	int i, n = pagesize();
+
+	if (lines > 0)
+		return matchv[nmatches > (size_t)n ? nmatches - n : 0];
+	for (i = 0, item = matchend; item->left; item = item->left)
+		if ((i += itemw_clamp(item, n)) + itemw_clamp(item->left, n) > n)
+			break;
+	return item;
+}
+
+/* index the match list once it is final, calcoffsets() and friends page
+ * through the array instead of walking the list */
+static void
+matchindex(void)
+{
+	struct item *item;
+
+	for (nmatches = 0, item = matches; item; item = item->right) {
+		if (nmatches == matchvsize) {
+			matchvsize = matchvsize ? matchvsize * 2 : BUFSIZ;
+			if (!(matchv = realloc(matchv, matchvsize * sizeof *matchv)))
+				die("cannot realloc %zu bytes:", matchvsize * sizeof *matchv);
+		}
+		item->pos = nmatches;
+		matchv[nmatches++] = item;
+	}
+}
+
 static void
 cleanup(void)
 {
@@ -186,11 +247,14 @@ cleanup(void)
 	for (i = 0; items && items[i].text; ++i)
 		free(items[i].text);
 	free(items);
+	free(byweight);
 	for (i = 0; i < hplength; ++i)
 		free(hpitems[i]);
 	free(hpitems);
+	free(layouts);
 	drw_free(drw);
-	XSync(dpy, False);
+	if (xdb)
+		XrmDestroyDatabase(xdb);
 	XCloseDisplay(dpy);
 	free(selid);
 }
@@ -206,100 +270,72 @@ cistrstr(const char *s, const char *sub)
 	return NULL;
 }
 
+/* letter after >> or : naming the scheme of the markup, see itemstyle() */
 static int
-drawitem(struct item *item, int x, int y, int w)
+stylescheme(char c)
 {
-	int r;
-	char *text = item->text;
-
-	int iscomment = 0;
-	if (text[0] == '>') {
-		if (text[1] == '>') {
-			iscomment = 3;
-			switch (text[2]) {
-			case 'r':
-				drw_setscheme(drw, scheme[SchemeRed]);
-				break;
-			case 'g':
-				drw_setscheme(drw, scheme[SchemeGreen]);
-				break;
-			case 'y':
-				drw_setscheme(drw, scheme[SchemeYellow]);
-				break;
-			case 'b':
-				drw_setscheme(drw, scheme[SchemeBlue]);
-				break;
-			case 'p':
-				drw_setscheme(drw, scheme[SchemePurple]);
-				break;
-			case 'h':
-				drw_setscheme(drw, scheme[SchemeNormHighlight]);
-				break;
-			case 's':
-				drw_setscheme(drw, scheme[SchemeSel]);
-				break;
-			default:
-				iscomment = 1;
-				drw_setscheme(drw, scheme[SchemeNorm]);
-			break;
-			}
-		} else {
-			drw_setscheme(drw, scheme[SchemeNorm]);
-			iscomment = 1;
-		}
-	} else if (text[0] == ':') {
-		iscomment = 2;
-		if (item == sel) {
-			switch (text[1]) {
-			case 'r':
-				drw_setscheme(drw, scheme[SchemeRed]);
-				break;
-			case 'g':
-				drw_setscheme(drw, scheme[SchemeGreen]);
-				break;
-			case 'y':
-				drw_setscheme(drw, scheme[SchemeYellow]);
-				break;
-			case 'b':
-				drw_setscheme(drw, scheme[SchemeBlue]);
-				break;
-			case 'p':
-				drw_setscheme(drw, scheme[SchemePurple]);
-				break;
-			case 'h':
-				drw_setscheme(drw, scheme[SchemeNormHighlight]);
-				break;
-			case 's':
-				drw_setscheme(drw, scheme[SchemeSel]);
-				break;
-			default:
-				drw_setscheme(drw, scheme[SchemeSel]);
-				iscomment = 0;
-				break;
-			}
-		} else {
-			drw_setscheme(drw, scheme[SchemeNorm]);
+	switch (c) {
+	case 'r': return SchemeRed;
+	case 'g': return SchemeGreen;
+	case 'y': return SchemeYellow;
+	case 'b': return SchemeBlue;
+	case 'p': return SchemePurple;
+	case 'h': return SchemeNormHighlight;
+	case 's': return SchemeSel;
+	default:  return SchemeLast;
+	}
+}
+
+/* Decode the markup in front of an item once, when it is read:
+ *   >text     shown as text
+ *   >>ctext   shown as text, c being one of the letters in stylescheme()
+ *   :ctext    shown as text, as is while selected unless c is such a letter
+ *   :c ICOtext  ICO, three bytes, drawn as an icon in scheme c while selected */
+static void
+itemstyle(struct item *item)
+{
+	const char *t = item->text;
+	size_t len = strlen(t);
+
+	item->style = SchemeNorm;
+	item->off = item->seloff = item->icon = 0;
+	if (t[0] == '>') {
+		item->off = item->seloff = t[1] == '>' && stylescheme(t[2]) != SchemeLast ? 3 : 1;
+	} else if (t[0] == ':') {
+		item->off = MIN(len, 2);
+		if ((item->style = stylescheme(t[1])) != SchemeLast)
+			item->seloff = item->off;
+		if (t[1] && t[2] == ' ') {
+			item->icon = MIN(len - 3, 3);
+			item->off = MIN(len, 6);
+			if (item->seloff)
+				item->seloff = item->off;
 		}
 	}
+}
+
+static int
+drawitem(struct item *item, int x, int y, int w)
+{
+	int r;
+	char *text = item->text, c;
+	int iscomment = item == sel ? item->seloff : item->off;
 
 	int temppadding = 0;
-	if (iscomment == 2) {
-		if (text[2] == ' ') {
-			temppadding = drw->fonts->h * 3;
-			animated = 1;
-			char dest[1000];
-			strcpy(dest, text);
-			dest[6] = '\0';
-			drw_text(drw, x, y
-				, temppadding
-				, MAX(lineheight, bh)
-				, temppadding / 2.6
-				, dest + 3
-				, 0
-			);
-			iscomment = 6;
-			drw_setscheme(drw, sel == item ? scheme[SchemeHover] : scheme[SchemeNorm]);
-		}
+	if (item->icon && iscomment) {
+		temppadding = drw->fonts->h * 3;
+		animated = 1;
+		drw_setscheme(drw, scheme[item == sel ? item->style : SchemeNorm]);
+		c = text[3 + item->icon];
+		text[3 + item->icon] = '\0';
+		drw_text(drw, x, y
+			, temppadding
+			, MAX(lineheight, bh)
+			, temppadding / 2.6
+			, text + 3
+			, 0
+		);
+		text[3 + item->icon] = c;
 	}
 
 	char *output;
@@ -314,6 +350,8 @@ drawitem(struct item *item, int x, int y, int w)
 
 	if (item == sel)
 		drw_setscheme(drw, scheme[SchemeSel]);
+	else if (item == hovered)
+		drw_setscheme(drw, scheme[SchemeHover]);
 	else if (item->hp)
 		drw_setscheme(drw, scheme[SchemeHp]);
 	else if (issel(item->id))
@@ -322,7 +360,7 @@ drawitem(struct item *item, int x, int y, int w)
 		drw_setscheme(drw, scheme[SchemeNorm]);
 
 	r = drw_text(drw
-		, x + ((iscomment == 6) ? temppadding : 0)
+		, x + temppadding
 		, y
 		, w
 		, bh
@@ -330,7 +368,7 @@ drawitem(struct item *item, int x, int y, int w)
 		, output + iscomment
 		, 0
 		);
-	drawhighlights(item, output + iscomment, x + ((iscomment == 6) ? temppadding : 0), y, w);
+	drawhighlights(item, output + iscomment, x + temppadding, y, w);
 	return r;
 }
 
@@ -339,15 +377,34 @@ drawmenu(void)
 {
 	static int curpos, oldcurlen;
 	int curlen, rcurlen;
-	struct item *item;
-	int x = 0, y = 0, w, rpad = 0, itw = 0, stw = 0;
+	struct item *item, *slot;
+	int x = 0, w, rpad = 0, itw = 0, stw = 0;
 	int fh = drw->fonts->h;
-	char *censort;
+	char *censort = NULL, *input;
+	const unsigned int *adv;
+	size_t len, l, r;
+	int i, full, bar, slots, rw, rx, ry, dx = 0, dy = 0, dh = 0;
+	size_t nhit = 1;
+
+	/* only what changed since the last frame is drawn and copied, except
+	 * for the horizontal list which shifts with every change */
+	flushmatch();
+	drw_fence(drw, win);
+	recalculatenumbers();
+	slots = lines > 0 ? lines * (columns ? columns : 1) : 0;
+	full = damagefull(slots) || lines <= 0;
+	bar = damagebar() || full;
+	/* the hit table is rebuilt every frame, drawn or not */
+	nhits = 0;
+	hitadd(0, 0, 0, mw, bh, HitInput, NULL);
 
 	drw_setscheme(drw, scheme[SchemeNorm]);
-	drw_rect(drw, 0, 0, mw, mh, 1, 1);
+	if (full)
+		drw_rect(drw, 0, 0, mw, mh, 1, 1);
+	else if (bar)
+		drw_rect(drw, 0, 0, mw, bh, 1, 1);
 
-	if (prompt && *prompt) {
+	if (bar && prompt && *prompt) {
 		x = drw_text(drw, x, 0, promptw, bh, lrpad / 2, prompt, 0
 		);
 	}
@@ -356,58 +413,86 @@ drawmenu(void)
 
 	w -= lrpad / 2;
 	x += lrpad / 2;
-	rcurlen = TEXTW(text + cursor) - lrpad;
-	curlen = TEXTW(text) - lrpad - rcurlen;
-	curpos += curlen - oldcurlen;
-	curpos = MIN(w, MAX(0, curpos));
-	curpos = MAX(curpos, w - rcurlen);
-	curpos = MIN(curpos, curlen);
-	oldcurlen = curlen;
-
-	drw_setscheme(drw, scheme[SchemeNorm]);
-	if (passwd) {
-		censort = ecalloc(1, sizeof(text));
-		memset(censort, '.', strlen(text));
-		drw_text_align(drw, x, 0, curpos, bh, censort, cursor, AlignR);
-		drw_text_align(drw, x + curpos, 0, w - curpos, bh, censort + cursor, strlen(censort) - cursor, AlignL);
+	if (bar) {
+		if (passwd) {
+			censort = ecalloc(1, sizeof(text));
+			memset(censort, '.', strlen(text));
+		}
+		input = passwd ? censort : text;
+		len = strlen(input);
+		adv = inputadvances(input, len);
+		rcurlen = adv[len] - adv[cursor];
+		curlen = adv[cursor];
+		curpos += curlen - oldcurlen;
+		curpos = MIN(w, MAX(0, curpos));
+		curpos = MAX(curpos, w - rcurlen);
+		curpos = MIN(curpos, curlen);
+		oldcurlen = curlen;
+
+		/* clip to what fits either side of the cursor beforehand, so
+		 * drw_text_align() never has to shorten the text */
+		l = inputleft(adv, cursor, curpos);
+		r = inputright(input, adv, cursor, len, MAX(w - curpos, 0));
+		drw_setscheme(drw, scheme[SchemeNorm]);
+		drw_text_align(drw, x, 0, curpos, bh, input + l, cursor - l, AlignR);
+		drw_text_align(drw, x + curpos, 0, w - curpos, bh, input + cursor, r - cursor, AlignL);
 		free(censort);
-	} else {
-		drw_text_align(drw, x, 0, curpos, bh, text, cursor, AlignR);
-		drw_text_align(drw, x + curpos, 0, w - curpos, bh, text + cursor, strlen(text) - cursor, AlignL);
+		drw_rect(drw, x + curpos - 1, 2 + (bh-fh)/2, 2, fh - 4, 1, 0);
 	}
-	drw_rect(drw, x + curpos - 1, 2 + (bh-fh)/2, 2, fh - 4, 1, 0);
 
-	recalculatenumbers();
 	rpad = TEXTW(numbers);
 	rpad += 2 * sp;
 	rpad += border_width;
 	if (lines > 0) {
-		/* draw grid */
-		int i = 0;
-		for (item = curr; item != next; item = item->right, i++)
-			if (columns)
-				drawitem(
-					item,
-					0 + ((i / lines) *  (mw / columns)),
-					y + (((i % lines) + 1) * bh),
-					mw / columns
-				);
-			else
-				drawitem(item, 0, y += bh, mw);
+		/* draw grid, slot i is row i % lines of column i / lines */
+		rw = columns ? mw / columns : mw;
+		for (i = 0, item = curr; i < slots; i++) {
+			slot = item != next ? item : NULL;
+			if (slot)
+				item = item->right;
+			rx = columns ? (i / lines) * rw : 0;
+			ry = (i % lines + 1) * bh;
+			hitadd(1 + (i % lines) * (slots / lines) + i / lines, rx, ry, rw, bh, HitItem, slot);
+			if (!damagerow(i, slot) && !full)
+				continue;
+			if (!full) {
+				drw_setscheme(drw, scheme[SchemeNorm]);
+				drw_rect(drw, rx, ry, rw, bh, 1, 1);
+			}
+			if (slot)
+				drawitem(slot, rx, ry, rw);
+			if (full)
+				continue;
+			/* copy adjacent rows of a column at once */
+			if (dh && dx == rx && dy + dh == ry) {
+				dh += bh;
+			} else {
+				if (dh)
+					drw_map(drw, win, dx, dy, rw, dh);
+				dx = rx;
+				dy = ry;
+				dh = bh;
+			}
+		}
 	} else if (matches) {
 		/* draw horizontal list */
 		x += inputw;
 		w = TEXTW("<");
+		/* without a left arrow its space belongs to the input */
+		hits[0].w = x + (curr->left ? 0 : w);
 		if (curr->left) {
 			drw_setscheme(drw, scheme[SchemeNorm]);
 			drw_text(drw, x, 0, w, bh, lrpad / 2, "<", 0
 			);
+			hitadd(nhit++, x, 0, w, bh, HitLeft, NULL);
 		}
 		x += w;
 		for (item = curr; item != next; item = item->right) {
 			stw = TEXTW(">");
-			itw = textw_clamp(item->text, mw - x - stw - rpad);
+			itw = itemw_clamp(item, mw - x - stw - rpad);
+			rx = x;
 			x = drawitem(item, x, 0, itw);
+			hitadd(nhit++, rx, 0, x - rx, bh, HitItem, item);
 		}
 		if (next) {
 			w = TEXTW(">");
@@ -416,45 +501,90 @@ drawmenu(void)
 				, ">"
 				, 0
 			);
+			hitadd(nhit++, mw - w - rpad, 0, w, bh, HitRight, NULL);
 		}
 	}
-	drw_setscheme(drw, scheme[SchemeNorm]);
-	drw_text(drw, mw - rpad, 0, TEXTW(numbers), bh, lrpad / 2, numbers, 0);
-	drw_map(drw, win, 0, 0, mw, mh);
+	if (bar) {
+		drw_setscheme(drw, scheme[SchemeNorm]);
+		drw_text(drw, mw - rpad, 0, TEXTW(numbers), bh, lrpad / 2, numbers, 0);
+	}
+	if (full) {
+		drw_map(drw, win, 0, 0, mw, mh);
+		return;
+	}
+	if (dh)
+		drw_map(drw, win, dx, dy, columns ? mw / columns : mw, dh);
+	if (bar)
+		drw_map(drw, win, 0, 0, mw, bh);
+}
+
+/* Sleep until an event arrives or for the next step of a backoff doubling
+ * up to maxdelay ms, whichever comes first; 0 once the deadline passed. */
+static int
+xwait(const struct timespec *deadline, int *delay, int maxdelay)
+{
+	struct pollfd pfd = { .fd = ConnectionNumber(dpy), .events = POLLIN };
+	struct timespec now;
+	long left;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	left = (deadline->tv_sec - now.tv_sec) * 1000
+	     + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+	if (left <= 0)
+		return 0;
+	poll(&pfd, 1, MIN(*delay, left));
+	*delay = MIN(*delay * 2, maxdelay);
+	return 1;
 }
 
 static void
 grabfocus(void)
 {
-	struct timespec ts = { .tv_sec = 0, .tv_nsec = 10000000  };
+	struct timespec deadline;
 	Window focuswin;
-	int i, revertwin;
+	int revertwin, delay = 1;
 
-	for (i = 0; i < 100; ++i) {
+	/* the FocusIn on win wakes xwait() */
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec++;
+	for (;;) {
 		XGetInputFocus(dpy, &focuswin, &revertwin);
 		if (focuswin == win)
-			return;
-		nanosleep(&ts, NULL);
+			break;
+		if (!xwait(&deadline, &delay, 8))
+			die("cannot grab focus");
 	}
-	die("cannot grab focus");
+	timing("grabfocus");
 }
 
 static void
 grabkeyboard(void)
 {
-	struct timespec ts = { .tv_sec = 0, .tv_nsec = 1000000  };
-	int i;
+	struct timespec deadline;
+	XEvent ev;
+	int delay = 1;
 
 	if (embed || managed)
 		return;
-	/* try to grab keyboard, we may have to wait for another process to ungrab */
-	for (i = 0; i < 1000; i++) {
-		if (XGrabKeyboard(dpy, DefaultRootWindow(dpy), True, GrabModeAsync,
-		                  GrabModeAsync, CurrentTime) == GrabSuccess)
-			return;
-		nanosleep(&ts, NULL);
+	/* try to grab keyboard, we may have to wait for another process to
+	 * ungrab, such as the window manager's key binding that started us.
+	 * Its release moves the focus back in NotifyUngrab mode, and those
+	 * focus events on root wake xwait(); the backoff covers the rest */
+	XSelectInput(dpy, root, FocusChangeMask);
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec++;
+	while (XGrabKeyboard(dpy, DefaultRootWindow(dpy), True, GrabModeAsync,
+	                     GrabModeAsync, CurrentTime) != GrabSuccess) {
+		if (!xwait(&deadline, &delay, 8))
+			die("cannot grab keyboard");
+		while (XCheckWindowEvent(dpy, root, FocusChangeMask, &ev))
+			if (ev.xfocus.mode == NotifyUngrab)
+				delay = 1;
 	}
-	die("cannot grab keyboard");
+	XSelectInput(dpy, root, NoEventMask);
+	while (XCheckWindowEvent(dpy, root, FocusChangeMask, &ev))
+		;
+	timing("grabkeyboard");
 }
 
 static void
@@ -467,46 +597,40 @@ match(void)
 		fuzzymatch();
 		return;
 	}
-	static char **tokv = NULL;
-	static int tokn = 0;
-
-	char buf[sizeof text], *s;
-	int i, tokc = 0;
-	size_t len, textsize;
+	unsigned int i;
+	size_t n, len, textsize;
+	struct item **order = sortmatches ? byweight : NULL;
 	struct item *item, *lprefix, *lsubstr, *prefixend, *substrend;
-	struct item *lhpprefix, *hpprefixend;
-
-	strcpy(buf, text);
-	/* separate input text into tokens to be matched individually */
-	for (s = strtok(buf, " "); s; tokv[tokc - 1] = s, s = strtok(NULL, " "))
-		if (++tokc > tokn && !(tokv = realloc(tokv, ++tokn * sizeof *tokv)))
-			die("cannot realloc %zu bytes:", tokn * sizeof *tokv);
-	len = tokc ? strlen(tokv[0]) : 0;
-
-	if (use_prefix) {
-		matches = lprefix = matchend = prefixend = NULL;
-		textsize = strlen(text);
-	} else {
-		matches = lprefix = lsubstr = matchend = prefixend = substrend = NULL;
-		textsize = strlen(text) + 1;
-	}
-	lhpprefix = hpprefixend = NULL;
-	for (item = items; item && item->text; item++)
+	struct item *lhpprefix, *hpprefixend, *lacronym, *acronymend;
+
+	/* separate input text into terms to be matched individually */
+	compilequery();
+	typoreset();
+	len = qleadlen;
+
+	matches = lprefix = lsubstr = matchend = prefixend = substrend = NULL;
+	textsize = strlen(text);
+	lhpprefix = hpprefixend = lacronym = acronymend = NULL;
+	for (n = 0; (item = order ? order[n] : items ? &items[n] : NULL) && item->text; n++)
 	{
-		for (i = 0; i < tokc; i++)
-			if (!fstrstr(item->text, tokv[i]))
-				break;
-		if (i != tokc && !(dynamic && *dynamic)) /* not all tokens match */
+		if (!querymatch(item, NULL) && !(dynamic && *dynamic)) { /* not all terms match */
+			if (sortmatches && acronymmatch(item))
+				appenditem(item, &lacronym, &acronymend);
+			else
+				typocandidate(item);
 			continue;
-		/* exact matches go first, then prefixes with high priority, then prefixes, then substrings */
+		}
+		/* exact matches go first, then prefixes with high priority, then prefixes,
+		 * then acronyms, then substrings */
 		if (!sortmatches)
  			appenditem(item, &matches, &matchend);
  		else
-		if (!tokc || !fstrncmp(text, item->text, textsize))
+		if (!qtermn || ((use_prefix ? item->mlen >= textsize : item->mlen == textsize)
+		&& !fstrncmp(text, item->text + item->mstart, textsize)))
 			appenditem(item, &matches, &matchend);
-		else if (item->hp && !fstrncmp(tokv[0], item->text, len))
+		else if (item->hp && item->mlen >= len && !fstrncmp(qlead, item->text + item->mstart, len))
 			appenditem(item, &lhpprefix, &hpprefixend);
-		else if (!fstrncmp(tokv[0], item->text, len))
+		else if (item->mlen >= len && !fstrncmp(qlead, item->text + item->mstart, len))
 			appenditem(item, &lprefix, &prefixend);
 		else if (!use_prefix)
 			appenditem(item, &lsubstr, &substrend);
@@ -527,6 +651,14 @@ match(void)
 			matches = lprefix;
 		matchend = prefixend;
 	}
+	if (lacronym) {
+		if (matches) {
+			matchend->right = lacronym;
+			lacronym->left = matchend;
+		} else
+			matches = lacronym;
+		matchend = acronymend;
+	}
 	if (!use_prefix && lsubstr)
 	{
 		if (matches) {
@@ -536,14 +668,21 @@ match(void)
 			matches = lsubstr;
 		matchend = substrend;
 	}
-	curr = sel = matches;
-
+	/* -n takes a unique match only, never one found by typos */
 	if (instant && matches && matches==matchend && !lsubstr) {
 		puts(matches->text);
 		cleanup();
 		exit(0);
 	}
 
+	/* items within a few typos go last, and only if little else matched */
+	for (i = 0, item = matches; item && i < typo_threshold; item = item->right)
+		i++;
+	if (i < typo_threshold)
+		typotier(&matches, &matchend);
+	curr = sel = matches;
+
+	matchindex();
 	calcoffsets();
 }
 
@@ -559,8 +698,22 @@ insert(const char *str, ssize_t n)
 	if (n > 0)
 		memcpy(&text[cursor], str, n);
 	cursor += n;
-	match();
+	/* match once per batch of key events, see run(); -n has to see
+	 * every intermediate state to select the first unique match */
+	if (instant)
+		match();
+	else
+		pendingmatch = 1;
+}
 
+/* run a match deferred by insert() */
+static void
+flushmatch(void)
+{
+	if (!pendingmatch)
+		return;
+	pendingmatch = 0;
+	match();
 }
 
 static size_t
@@ -590,6 +743,22 @@ movewordedge(int dir)
 	}
 }
 
+/* keys that move through or act on the matches rather than edit the input */
+static int
+isnavkey(KeySym ksym)
+{
+	switch (ksym) {
+	case XK_End: case XK_KP_End: case XK_Home: case XK_KP_Home:
+	case XK_Left: case XK_KP_Left: case XK_Right: case XK_KP_Right:
+	case XK_Up: case XK_KP_Up: case XK_Down: case XK_KP_Down:
+	case XK_Next: case XK_KP_Next: case XK_Prior: case XK_KP_Prior:
+	case XK_Return: case XK_KP_Enter: case XK_Tab:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
 static void
 keypress(XKeyEvent *ev)
 {
@@ -613,6 +782,10 @@ keypress(XKeyEvent *ev)
 		break;
 	}
 
+	/* everything but editing the input looks at the matches */
+	if (ev->state & (ControlMask | Mod1Mask) || isnavkey(ksym))
+		flushmatch();
+
 	if (ev->state & ControlMask) {
 		switch(ksym) {
 		case XK_a: expect("ctrl-a", ev); ksym = XK_Home;      break;
@@ -729,12 +902,8 @@ insert:
 		}
 		if (next) {
 			/* jump to end of list and position items in reverse */
-			curr = matchend;
-			calcoffsets();
-			curr = prev;
+			curr = lastpage();
 			calcoffsets();
-			while (next && (curr = curr->right))
-				calcoffsets();
 		}
 		sel = matchend;
 		break;
@@ -863,7 +1032,7 @@ insert:
 	}
 
 draw:
-	drawmenu();
+	pendingdraw = 1;
 }
 
 static void
@@ -943,6 +1112,7 @@ readstdin(void)
 				die("cannot realloc %zu bytes:", size);
 		if (line[len - 1] == '\n')
 			line[len - 1] = '\0';
+		items[i].weight = weighted ? readweight(line) : 0;
 
 		items[i].text = line;
 		if (separator && (p = separator_greedy ?
@@ -961,9 +1131,15 @@ readstdin(void)
 		items[i].index = i;
 
 		items[i].hp = arrayhas(hpitems, hplength, items[i].text);
+		nthspan(&items[i]);
+		items[i].chars = charmask(items[i].text);
+		items[i].bounds = wordstarts(items[i].text + items[i].mstart, items[i].mlen);
+		itemstyle(&items[i]);
 	}
 	if (items)
 		items[i].text = NULL;
+	nitems = i;
+	weightorder();
 	lines = MIN(lines, i);
 }
 
@@ -971,12 +1147,12 @@ static void
 run(void)
 {
 	XEvent ev;
-	int i;
 
 	while (!XNextEvent(dpy, &ev)) {
 		if (preselected) {
-			for (i = 0; i < preselected; i++) {
-				if (sel && sel->right && (sel = sel->right) == next) {
+			if (sel) {
+				sel = matchv[MIN(sel->pos + preselected, nmatches - 1)];
+				while (next && sel->pos >= next->pos) {
 					curr = next;
 					calcoffsets();
 				}
@@ -984,12 +1160,30 @@ run(void)
 			drawmenu();
 			preselected = 0;
 		}
+		/* the input method may take the last key of a batch */
 		if (XFilterEvent(&ev, win))
-			continue;
+			goto flush;
 		switch(ev.type) {
 		case ButtonPress:
+			/* clicks resolve against the hit table of the frame for
+			 * the current matches, not one queued keys made stale */
+			if (pendingmatch || pendingdraw) {
+				pendingdraw = 0;
+				drawmenu();
+			}
 			buttonpress(&ev);
 			break;
+		case MotionNotify:
+			/* only where the pointer ended up matters */
+			while (XCheckTypedWindowEvent(dpy, win, MotionNotify, &ev))
+				;
+			if (ev.xmotion.window == win)
+				motion(ev.xmotion.x, ev.xmotion.y);
+			break;
+		case LeaveNotify:
+			if (ev.xcrossing.window == win)
+				motion(-1, -1);
+			break;
 		case DestroyNotify:
 			if (ev.xdestroywindow.window != win)
 				break;
@@ -999,9 +1193,13 @@ run(void)
 			if (ev.xexpose.count == 0)
 				drw_map(drw, win, 0, 0, mw, mh);
 			break;
+		default:
+			drw_fenced(drw, &ev);
+			break;
 		case FocusIn:
-			/* regrab focus from parent window */
-			if (ev.xfocus.window != win)
+			/* regrab focus from parent window; root only reports
+			 * the keyboard grab, see grabkeyboard() */
+			if (ev.xfocus.window != win && ev.xfocus.window != root)
 				grabfocus();
 			break;
 		case KeyPress:
@@ -1016,32 +1214,45 @@ run(void)
 				XRaiseWindow(dpy, win);
 			break;
 		}
+flush:
+		/* queued key events are applied first, then matched and drawn once */
+		if (pendingdraw && !XPending(dpy)) {
+			pendingdraw = 0;
+			drawmenu();
+		}
 	}
 }
 
 static void
 setup(void)
 {
-	int x, y, i, j;
-	unsigned int du;
+	int x, y, w, h, j;
 	XSetWindowAttributes swa;
 	XIM xim;
-	Window w, dw, *dws;
-	XWindowAttributes wa;
 	XClassHint ch = {"dmenu", "dmenu"};
+	char *atomnames[] = { "CLIPBOARD", "UTF8_STRING", "_NET_WM_WINDOW_TYPE",
+	                      "_NET_WM_WINDOW_TYPE_DOCK", "_NET_WM_NAME" };
+	Atom atoms[LENGTH(atomnames)];
 #ifdef XINERAMA
 	XineramaScreenInfo *info;
-	Window pw;
-	int a, di, n, area = 0;
+	int a, i, n, area = 0;
 #endif
 	/* init appearance */
 	for (j = 0; j < SchemeLast; j++)
 		scheme[j] = drw_scm_create(drw, (const char**)colors[j], alphas[j], 2);
 
-	clip = XInternAtom(dpy, "CLIPBOARD",   False);
-	utf8 = XInternAtom(dpy, "UTF8_STRING", False);
-	type = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
-	dock = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DOCK", False);
+	/* one round-trip for all atoms */
+	XInternAtoms(dpy, atomnames, LENGTH(atomnames), False, atoms);
+	clip = atoms[0];
+	utf8 = atoms[1];
+	type = atoms[2];
+	dock = atoms[3];
+	netwmname = atoms[4];
+
+	/* everything below depends on the items */
+	ingestwait();
+	timing("ingest");
+	sendqueries();
 
 	/* calculate menu geometry */
 	bh = drw->fonts->h + 2;
@@ -1052,25 +1263,18 @@ setup(void)
 #ifdef XINERAMA
 	i = 0;
 	if (parentwin == root && (info = XineramaQueryScreens(dpy, &n))) {
-		XGetInputFocus(dpy, &w, &di);
 		if (mon >= 0 && mon < n)
 			i = mon;
-		else if (w != root && w != PointerRoot && w != None) {
-			/* find top-level window containing current input focus */
-			do {
-				if (XQueryTree(dpy, (pw = w), &dw, &w, &dws, &du) && dws)
-					XFree(dws);
-			} while (w != root && w != pw);
+		else if (focusrect(&x, &y, &w, &h)) {
 			/* find xinerama screen with which the window intersects most */
-			if (XGetWindowAttributes(dpy, pw, &wa))
-				for (j = 0; j < n; j++)
-					if ((a = INTERSECT(wa.x, wa.y, wa.width, wa.height, info[j])) > area) {
-						area = a;
-						i = j;
-					}
+			for (j = 0; j < n; j++)
+				if ((a = INTERSECT(x, y, w, h, info[j])) > area) {
+					area = a;
+					i = j;
+				}
 		}
 		/* no focused window is on screen, so use pointer location instead */
-		if (mon < 0 && !area && XQueryPointer(dpy, root, &dw, &dw, &x, &y, &di, &di, &du))
+		if (mon < 0 && !area && pointerpos(&x, &y))
 			for (i = 0; i < n; i++)
 				if (INTERSECT(x, y, 1, 1, info[i]) != 0)
 					break;
@@ -1088,19 +1292,18 @@ setup(void)
 	} else
 #endif
 	{
-		if (!XGetWindowAttributes(dpy, parentwin, &wa))
-			die("could not get embedding window attributes: 0x%lx",
-			    parentwin);
+		parentsize(&w, &h);
 		if (center) {
-			mw = MIN(MAX(max_textw() + promptw, min_width), wa.width);
-			x = (wa.width  - mw) / 2;
-			y = (wa.height - mh) / 2;
+			mw = MIN(MAX(max_textw() + promptw, min_width), w);
+			x = (w  - mw) / 2;
+			y = (h - mh) / 2;
 		} else {
 			x = dmx;
-			y = topbar ? dmy : wa.height - mh - dmy;
-			mw = (dmw>0 ? dmw : wa.width);
+			y = topbar ? dmy : h - mh - dmy;
+			mw = (dmw>0 ? dmw : w);
 		}
 	}
+	dropqueries();
 	inputw = mw / 3; /* input width: ~33.33% of monitor width */
 	match();
 
@@ -1109,7 +1312,8 @@ setup(void)
 	swa.background_pixel = 0;
 	swa.colormap = cmap;
 	swa.event_mask = ExposureMask | KeyPressMask | VisibilityChangeMask
-		| ButtonPressMask
+		| ButtonPressMask | PointerMotionMask | LeaveWindowMask
+		| FocusChangeMask
 	;
 	win = XCreateWindow(
 		dpy, parentwin,
@@ -1136,22 +1340,18 @@ setup(void)
 		char *windowtitle = prompt != NULL ? prompt : "dmenu";
 		Xutf8TextListToTextProperty(dpy, &windowtitle, 1, XUTF8StringStyle, &prop);
 		XSetWMName(dpy, win, &prop);
-		XSetTextProperty(dpy, win, &prop, XInternAtom(dpy, "_NET_WM_NAME", False));
+		XSetTextProperty(dpy, win, &prop, netwmname);
 		XFree(prop.value);
 	}
 
 	XMapRaised(dpy, win);
 	if (embed) {
-		XSelectInput(dpy, parentwin, FocusChangeMask | SubstructureNotifyMask);
-		if (XQueryTree(dpy, parentwin, &dw, &w, &dws, &du) && dws) {
-			for (i = 0; i < du && dws[i] != win; ++i)
-				XSelectInput(dpy, dws[i], FocusChangeMask);
-			XFree(dws);
-		}
+		watchparent();
 		grabfocus();
 	}
 	drw_resize(drw, mw, mh);
 	drawmenu();
+	timing("setup");
 }
 
 static void
@@ -1164,10 +1364,11 @@ usage(void)
 		"n"
 		"x"
 		"F"
+		"T"
 		"P"
 		"S"
 		"] "
-		"[-wm] "
+		"[-wm] [-rw] "
 		"[-g columns] "
 		"[-l lines] [-p prompt] [-fn font] [-m monitor]"
 		"\n             [-nb color] [-nf color] [-sb color] [-sf color] [-w windowid]"
@@ -1184,31 +1385,24 @@ usage(void)
 		" [-H histfile]"
 		" [-X xoffset] [-Y yoffset] [-W width]" // (arguments made upper case due to conflicts)
 		"\n             [-nhb color] [-nhf color] [-shb color] [-shf color]" // highlight colors
-		"\n             [-d separator] [-D separator]"
+		"\n             [-d separator] [-D separator] [-nth fields] [-nd separator]"
 		"\n");
 }
 
 int
 main(int argc, char *argv[])
 {
-	XWindowAttributes wa;
 	int i;
 	int fast = 0;
 
+	timing("start");
 	if (!setlocale(LC_CTYPE, "") || !XSupportsLocale())
 		fputs("warning: no locale support\n", stderr);
 	if (!(dpy = XOpenDisplay(NULL)))
 		die("cannot open display");
+	timing("display");
 	screen = DefaultScreen(dpy);
 	root = RootWindow(dpy, screen);
-	if (!embed || !(parentwin = strtol(embed, NULL, 0)))
-		parentwin = root;
-	if (!XGetWindowAttributes(dpy, parentwin, &wa))
-		die("could not get embedding window attributes: 0x%lx",
-		    parentwin);
-
-	xinitvisual();
-	drw = drw_create(dpy, screen, root, wa.width, wa.height, visual, depth, cmap);
 	readxresources();
 
 	for (i = 1; i < argc; i++)
@@ -1233,6 +1427,8 @@ main(int argc, char *argv[])
 			use_prefix = !use_prefix;
 		} else if (!strcmp(argv[i], "-F")) { /* disable/enable fuzzy matching, depends on default */
 			fuzzy = !fuzzy;
+		} else if (!strcmp(argv[i], "-T")) { /* disable/enable typo tolerant matching, depends on default */
+			typos = !typos;
 		} else if (!strcmp(argv[i], "-P")) { /* is the input a password */
 			passwd = 1;
 		} else if (!strcmp(argv[i], "-ex")) { /* expect key */
@@ -1241,6 +1437,8 @@ main(int argc, char *argv[])
 			sortmatches = 0;
 		} else if (!strcmp(argv[i], "-ix")) { /* adds ability to return index in list */
 			print_index = 1;
+		} else if (!strcmp(argv[i], "-rw")) { /* lines start with a numeric rank weight */
+			weighted = 1;
 		} else if (i + 1 == argc)
 			usage();
 		/* these options take one argument */
@@ -1300,6 +1498,10 @@ main(int argc, char *argv[])
 			separator = argv[++i][0];
 			separator_reverse = argv[i][1] == '|';
 		}
+		else if (!strcmp(argv[i], "-nth"))  /* match only these fields */
+			nthparse(argv[++i]);
+		else if (!strcmp(argv[i], "-nd"))   /* -nth field separator */
+			nthdelim = argv[++i][0];
 		else if (!strcmp(argv[i], "-ps"))   /* preselected item */
 			preselected = atoi(argv[++i]);
 		else if (!strcmp(argv[i], "-dy"))  /* dynamic command to run */
@@ -1307,14 +1509,28 @@ main(int argc, char *argv[])
 		else if (!strcmp(argv[i], "-bw"))  /* border width around dmenu */
 			border_width = atoi(argv[++i]);
 		else if (!strcmp(argv[i], "-it")) {   /* adds initial text */
-			const char * text = argv[++i];
-			insert(text, strlen(text));
+			/* not insert(), there is nothing to match yet */
+			if (strlen(argv[++i]) < sizeof text - cursor) {
+				strcpy(text + cursor, argv[i]);
+				cursor += strlen(argv[i]);
+			}
 		}
 		else
 			usage();
 
+	ingeststart();
+
+	if (!embed || !(parentwin = strtol(embed, NULL, 0)))
+		parentwin = root;
+	if (!XGetWindowAttributes(dpy, parentwin, &parentwa))
+		die("could not get embedding window attributes: 0x%lx",
+		    parentwin);
+
+	xinitvisual();
+	drw = drw_create(dpy, screen, root, parentwa.width, parentwa.height, visual, depth, cmap);
 	if (!drw_fontset_create(drw, (const char**)fonts, LENGTH(fonts)))
 		die("no fonts could be loaded.");
+	timing("fonts");
 
 	lrpad = drw->fonts->h;
 
@@ -1328,17 +1544,10 @@ main(int argc, char *argv[])
 	if (pledge("stdio rpath", NULL) == -1)
 		die("pledge");
 #endif
-	loadhistory();
-
-	if (fast && !isatty(0)) {
-		grabkeyboard();
-		if (!(dynamic && *dynamic))
-			readstdin();
-	} else {
-		if (!(dynamic && *dynamic))
-			readstdin();
-		grabkeyboard();
-	}
+	/* without -f the keyboard is only grabbed once stdin is read */
+	if (!fast || isatty(0))
+		ingestwait();
+	grabkeyboard();
 	setup();
 	run();
 
@@ -1,15 +1,31 @@
 /* See LICENSE file for copyright and license details. */
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <X11/Xlib.h>
 #include <X11/Xft/Xft.h>
+#ifdef SHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#include FT_LCD_FILTER_H
+#endif
 
 #include "drw.h"
 #include "util.h"
+#include "patch/fontcache.h"
+#ifdef SHM
+#include "patch/shm.h"
+#endif
 
 #define UTF_INVALID 0xFFFD
 #define UTF_SIZ     4
+#define GLYPH_DIRECT  256  /* ASCII and Latin-1 */
+#define GLYPH_HASHED  1024 /* everything else */
 
 static const unsigned char utfbyte[UTF_SIZ + 1] = {0x80,    0, 0xC0, 0xE0, 0xF0};
 static const unsigned char utfmask[UTF_SIZ + 1] = {0xC0, 0x80, 0xE0, 0xF0, 0xF8};
@@ -75,7 +91,13 @@ drw_create(Display *dpy, int screen, Window root, unsigned int w, unsigned int h
 	drw->cmap = cmap;
 	drw->drawable = XCreatePixmap(dpy, root, w, h, depth);
 	drw->gc = XCreateGC(dpy, drw->drawable, 0, NULL);
+	/* copies report completion, see drw_fence() */
+	XSetGraphicsExposures(dpy, drw->gc, True);
 	XSetLineAttributes(dpy, drw->gc, 1, LineSolid, CapButt, JoinMiter);
+	drw->xftdraw = XftDrawCreate(dpy, drw->drawable, visual, cmap);
+#ifdef SHM
+	shm_create(drw);
+#endif
 
 	return drw;
 }
@@ -88,17 +110,40 @@ drw_resize(Drw *drw, unsigned int w, unsigned int h)
 
 	drw->w = w;
 	drw->h = h;
+	/* whatever was queued belonged to the old pixmap */
+	drw->nrects = drw->nruns = drw->nspecs = 0;
 	if (drw->drawable)
 		XFreePixmap(drw->dpy, drw->drawable);
 	drw->drawable = XCreatePixmap(drw->dpy, drw->root, w, h, drw->depth);
+	if (drw->xftdraw)
+		XftDrawChange(drw->xftdraw, drw->drawable);
+	else
+		drw->xftdraw = XftDrawCreate(drw->dpy, drw->drawable, drw->visual, drw->cmap);
+#ifdef SHM
+	if (drw->shm)
+		shm_resize(drw);
+#endif
 }
 
 void
 drw_free(Drw *drw)
 {
+	XftDrawDestroy(drw->xftdraw);
+#ifdef SHM
+	if (drw->shm)
+		shm_free(drw);
+#endif
+	free(drw->rects);
+	free(drw->rectpix);
+	free(drw->runs);
+	free(drw->specs);
+	free(drw->specbuf);
+	free(drw->specw);
 	XFreePixmap(drw->dpy, drw->drawable);
 	XFreeGC(drw->dpy, drw->gc);
+	fontcache_save();
 	drw_fontset_free(drw->fonts);
+	free(drw->glyphs);
 	free(drw);
 }
 
@@ -146,6 +191,68 @@ xfont_create(Drw *drw, const char *fontname, FcPattern *fontpattern)
 	return font;
 }
 
+/* Resolve a font through the fontconfig cache without opening it; its
+ * coverage decides whether xfont_open is ever needed. */
+static Fnt *
+xfont_defer(Drw *drw, const char *fontname)
+{
+	Fnt *font;
+	FcPattern *pattern, *match;
+	FcCharSet *charset;
+	FcResult result;
+
+	if (!(pattern = FcNameParse((FcChar8 *) fontname))) {
+		fprintf(stderr, "error, cannot parse font name to pattern: '%s'\n", fontname);
+		return NULL;
+	}
+	match = XftFontMatch(drw->dpy, drw->screen, pattern, &result);
+	if (!match || FcPatternGetCharSet(match, FC_CHARSET, 0, &charset) != FcResultMatch) {
+		/* no coverage to go by */
+		if (match)
+			FcPatternDestroy(match);
+		FcPatternDestroy(pattern);
+		return xfont_create(drw, fontname, NULL);
+	}
+
+	font = ecalloc(1, sizeof(Fnt));
+	font->pattern = pattern;
+	font->match = match;
+	font->charset = charset;
+	font->dpy = drw->dpy;
+
+	return font;
+}
+
+static int
+xfont_open(Drw *drw, Fnt *font)
+{
+	if (font->xfont)
+		return 1;
+	if (!font->match)
+		return 0;
+	if (!(font->xfont = XftFontOpenPattern(drw->dpy, font->match))) {
+		fprintf(stderr, "error, cannot load font from pattern.\n");
+		FcPatternDestroy(font->match);
+	}
+	/* the pattern belongs to xfont now */
+	font->match = NULL;
+	font->charset = NULL;
+	if (!font->xfont)
+		return 0;
+	font->h = font->xfont->ascent + font->xfont->descent;
+	return 1;
+}
+
+static int
+xfont_covers(Drw *drw, Fnt *font, long utf8codepoint)
+{
+	if (!font->xfont && !(font->charset
+	    && FcCharSetHasChar(font->charset, utf8codepoint)
+	    && xfont_open(drw, font)))
+		return 0;
+	return XftCharExists(drw->dpy, font->xfont, utf8codepoint);
+}
+
 static void
 xfont_free(Fnt *font)
 {
@@ -153,7 +260,10 @@ xfont_free(Fnt *font)
 		return;
 	if (font->pattern)
 		FcPatternDestroy(font->pattern);
-	XftFontClose(font->dpy, font->xfont);
+	if (font->match)
+		FcPatternDestroy(font->match);
+	if (font->xfont)
+		XftFontClose(font->dpy, font->xfont);
 	free(font);
 }
 
@@ -167,11 +277,20 @@ drw_fontset_create(Drw* drw, const char *fonts[], size_t fontcount)
 		return NULL;
 
 	for (i = 1; i <= fontcount; i++) {
-		if ((cur = xfont_create(drw, fonts[fontcount - i], NULL))) {
+		if ((cur = xfont_defer(drw, fonts[fontcount - i]))) {
 			cur->next = ret;
 			ret = cur;
 		}
 	}
+	/* only the first usable font is opened here, it sizes the menu; the
+	 * rest wait until a codepoint is not covered by an earlier font */
+	while (ret && !xfont_open(drw, ret)) {
+		cur = ret->next;
+		ret->next = NULL;
+		xfont_free(ret);
+		ret = cur;
+	}
+	drw_glyphs_clear(drw);
 	return (drw->fonts = ret);
 }
 
@@ -184,15 +303,67 @@ drw_fontset_free(Fnt *font)
 	}
 }
 
+/* #rgb or #rrggbb, scaled the way XParseColor does */
+static int
+clrparse(const char *clrname, XRenderColor *c)
+{
+	unsigned short v[3];
+	size_t n, i, j;
+	int d;
+
+	if (*clrname++ != '#' || ((n = strlen(clrname)) != 3 && n != 6))
+		return 0;
+	for (n /= 3, i = 0; i < 3; i++) {
+		for (v[i] = 0, j = 0; j < n; j++) {
+			d = clrname[i * n + j];
+			if (d >= '0' && d <= '9')
+				d -= '0';
+			else if ((d | 0x20) >= 'a' && (d | 0x20) <= 'f')
+				d = (d | 0x20) - 'a' + 10;
+			else
+				return 0;
+			v[i] = v[i] << 4 | d;
+		}
+		v[i] <<= 16 - 4 * n;
+	}
+	c->red = v[0];
+	c->green = v[1];
+	c->blue = v[2];
+	c->alpha = 0xffff;
+	return 1;
+}
+
+/* the bits of a 16 bit channel value in a TrueColor pixel */
+static unsigned long
+clrchannel(unsigned short v, unsigned long mask)
+{
+	int shift, len;
+
+	for (shift = 0; mask && !(mask & 1); mask >>= 1)
+		shift++;
+	for (len = 0; mask & 1; mask >>= 1)
+		len++;
+	return len ? (unsigned long)(v >> (16 - MIN(len, 16))) << shift : 0;
+}
+
 void
 drw_clr_create(Drw *drw, Clr *dest, const char *clrname, unsigned int alpha)
 {
+	XRenderColor c;
+
 	if (!drw || !dest || !clrname)
 		return;
 
-	if (!XftColorAllocName(drw->dpy, drw->visual, drw->cmap,
-	                       clrname, dest))
+	if (drw->visual->class == TrueColor && clrparse(clrname, &c)) {
+		/* the pixel follows from the visual, nothing to allocate */
+		dest->color = c;
+		dest->pixel = clrchannel(c.red, drw->visual->red_mask)
+		            | clrchannel(c.green, drw->visual->green_mask)
+		            | clrchannel(c.blue, drw->visual->blue_mask);
+	} else if (!XftColorAllocName(drw->dpy, drw->visual, drw->cmap,
+	                              clrname, dest)) {
 		die("error, cannot allocate color '%s'", clrname);
+	}
 
 	dest->pixel = (dest->pixel & 0x00ffffffU) | (alpha << 24);
 }
@@ -217,8 +388,10 @@ drw_scm_create(Drw *drw, const char *clrnames[], const unsigned int alphas[], si
 void
 drw_setfontset(Drw *drw, Fnt *set)
 {
-	if (drw)
+	if (drw) {
 		drw->fonts = set;
+		drw_glyphs_clear(drw);
+	}
 }
 
 void
@@ -228,36 +401,302 @@ drw_setscheme(Drw *drw, Clr *scm)
 		drw->scheme = scm;
 }
 
+/* Find a font for a codepoint missing from the fontset and append it to the
+ * set; the first font is returned when nothing covers the codepoint. */
+static Fnt *
+xfont_fallback(Drw *drw, long utf8codepoint)
+{
+	Fnt *usedfont, *curfont;
+	FcCharSet *fccharset;
+	FcPattern *fcpattern;
+	FcPattern *match;
+	XftResult result;
+	const struct fallback *fb;
+	int i;
+	/* keep track of a couple codepoints for which we have no match. */
+	enum { nomatches_len = 64 };
+	static struct { long codepoint[nomatches_len]; unsigned int idx; } nomatches;
+
+	for (i = 0; i < nomatches_len; ++i) {
+		/* avoid calling XftFontMatch if we know we won't find a match */
+		if (utf8codepoint == nomatches.codepoint[i])
+			return drw->fonts;
+	}
+
+	if (!drw->fonts->pattern) {
+		/* Refer to the comment in xfont_create for more information. */
+		die("the first font in the cache must be loaded from a font string.");
+	}
+
+	/* resolved by an earlier run */
+	if ((fb = fontcache_lookup(drw, utf8codepoint))) {
+		if (!fb->file)
+			return drw->fonts;
+		if ((usedfont = fontcache_open(drw, fb))
+		&& XftCharExists(drw->dpy, usedfont->xfont, utf8codepoint))
+			goto found;
+		/* the font changed, resolve again */
+		xfont_free(usedfont);
+	}
+
+	fccharset = FcCharSetCreate();
+	FcCharSetAddChar(fccharset, utf8codepoint);
+
+	fcpattern = FcPatternDuplicate(drw->fonts->pattern);
+	FcPatternAddCharSet(fcpattern, FC_CHARSET, fccharset);
+	FcPatternAddBool(fcpattern, FC_SCALABLE, FcTrue);
+
+	FcConfigSubstitute(NULL, fcpattern, FcMatchPattern);
+	FcDefaultSubstitute(fcpattern);
+	match = XftFontMatch(drw->dpy, drw->screen, fcpattern, &result);
+
+	FcCharSetDestroy(fccharset);
+	FcPatternDestroy(fcpattern);
+
+	if (!match) {
+		fontcache_add(utf8codepoint, NULL);
+		return drw->fonts;
+	}
+	/* match belongs to the font from here on, Xft may already have
+	 * destroyed it in favour of a cached font's pattern */
+	usedfont = xfont_create(drw, NULL, match);
+	if (usedfont && XftCharExists(drw->dpy, usedfont->xfont, utf8codepoint)) {
+		fontcache_add(utf8codepoint, usedfont->xfont->pattern);
+found:
+		for (curfont = drw->fonts; curfont->next; curfont = curfont->next)
+			; /* NOP */
+		curfont->next = usedfont;
+		/* codepoints that fell back to the first font may be covered now */
+		drw_glyphs_clear(drw);
+		return usedfont;
+	}
+	fontcache_add(utf8codepoint, NULL);
+	xfont_free(usedfont);
+	nomatches.codepoint[++nomatches.idx % nomatches_len] = utf8codepoint;
+	return drw->fonts;
+}
+
+/* Resolve the font drawing a codepoint and its advance width. ASCII and
+ * Latin-1 are indexed directly, the rest of the range hashes into a
+ * direct-mapped table; both are filled lazily. */
+static const Cp *
+drw_glyph(Drw *drw, long utf8codepoint)
+{
+	Cp *g;
+	Fnt *curfont;
+	FcChar32 ucs4 = utf8codepoint;
+	XGlyphInfo ext;
+
+	if (!drw->glyphs)
+		drw->glyphs = ecalloc(GLYPH_DIRECT + GLYPH_HASHED, sizeof(Cp));
+	if (utf8codepoint < GLYPH_DIRECT)
+		g = &drw->glyphs[utf8codepoint];
+	else
+		g = &drw->glyphs[GLYPH_DIRECT + (ucs4 * 2654435761U >> 16) % GLYPH_HASHED];
+	if (g->font && g->codepoint == utf8codepoint)
+		return g;
+
+	for (curfont = drw->fonts; curfont; curfont = curfont->next)
+		if (xfont_covers(drw, curfont, utf8codepoint))
+			break;
+	/* Regardless of whether or not a fallback font is found, the
+	 * character must be drawn. */
+	if (!curfont)
+		curfont = xfont_fallback(drw, utf8codepoint);
+	XftTextExtents32(drw->dpy, curfont->xfont, &ucs4, 1, &ext);
+	g->codepoint = utf8codepoint;
+	g->font = curfont;
+	g->w = ext.xOff;
+	g->glyph = XftCharIndex(drw->dpy, curfont->xfont, ucs4);
+	return g;
+}
+
+static void *
+erealloc(void *p, size_t size)
+{
+	if (!(p = realloc(p, size)))
+		die("cannot realloc %zu bytes:", size);
+	return p;
+}
+
+static int
+overlaps(const XRectangle *a, const XRectangle *b)
+{
+	return a->x < b->x + b->width && b->x < a->x + a->width &&
+	       a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+/* Queue a filled rectangle. Glyphs it covers entirely would be painted over
+ * anyway and are dropped; one it only partly covers has to reach the server
+ * first, so the batch is flushed. */
+static void
+drw_queue_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned long pixel)
+{
+	XRectangle r = { x, y, w, h }, g;
+	unsigned int i, j;
+	Run *run;
+
+	if (!w || !h)
+		return;
+	for (i = 0; i < drw->nruns; i++) {
+		run = &drw->runs[i];
+		if (!overlaps(&r, &run->box))
+			continue;
+		g = run->box;
+		for (j = run->first; j < run->first + run->n; j++) {
+			if (!drw->specs[j].font)
+				continue;
+			g.x = drw->specs[j].x;
+			g.width = drw->specw[j];
+			if (!overlaps(&r, &g))
+				continue;
+			if (g.x < r.x || g.x + g.width > r.x + r.width ||
+			    g.y < r.y || g.y + g.height > r.y + r.height) {
+				drw_flush(drw);
+				goto queue;
+			}
+			drw->specs[j].font = NULL;
+		}
+	}
+queue:
+	if (drw->nrects == drw->rectcap) {
+		drw->rectcap = drw->rectcap ? drw->rectcap * 2 : 64;
+		drw->rects = erealloc(drw->rects, drw->rectcap * sizeof(XRectangle));
+		drw->rectpix = erealloc(drw->rectpix, drw->rectcap * sizeof(unsigned long));
+	}
+	drw->rects[drw->nrects] = r;
+	drw->rectpix[drw->nrects++] = pixel;
+}
+
+/* Queue len bytes of text set in a single font, in the cell at x, y */
+static unsigned int
+drw_queue_text(Drw *drw, Fnt *font, Clr *color, int x, int y, unsigned int h, const char *text, unsigned int len)
+{
+	const Cp *glyph;
+	long utf8codepoint;
+	unsigned int i, n, ew = 0;
+	int ty = y + (h - font->h) / 2 + font->xfont->ascent;
+	Run *run;
+
+	if (drw->nruns == drw->runcap) {
+		drw->runcap = drw->runcap ? drw->runcap * 2 : 64;
+		drw->runs = erealloc(drw->runs, drw->runcap * sizeof(Run));
+	}
+	run = &drw->runs[drw->nruns++];
+	run->color = color;
+	run->first = drw->nspecs;
+	for (i = 0; i < len; i += n) {
+		if (!(n = utf8decode(text + i, &utf8codepoint, MIN(len - i, UTF_SIZ))))
+			break;
+		glyph = drw_glyph(drw, utf8codepoint);
+		if (drw->nspecs == drw->speccap) {
+			drw->speccap = drw->speccap ? drw->speccap * 2 : 256;
+			drw->specs = erealloc(drw->specs, drw->speccap * sizeof(XftGlyphFontSpec));
+			drw->specbuf = erealloc(drw->specbuf, drw->speccap * sizeof(XftGlyphFontSpec));
+			drw->specw = erealloc(drw->specw, drw->speccap * sizeof(unsigned short));
+		}
+		drw->specs[drw->nspecs].font = font->xfont;
+		drw->specs[drw->nspecs].glyph = glyph->glyph;
+		drw->specs[drw->nspecs].x = x + ew;
+		drw->specs[drw->nspecs].y = ty;
+		drw->specw[drw->nspecs++] = glyph->w;
+		ew += glyph->w;
+	}
+	run->n = drw->nspecs - run->first;
+	run->box.x = x;
+	run->box.y = y;
+	run->box.width = ew;
+	run->box.height = h;
+	return ew;
+}
+
 void
 drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int invert)
 {
+	unsigned long pixel;
+
 	if (!drw || !drw->scheme)
 		return;
-	XSetForeground(drw->dpy, drw->gc, invert ? drw->scheme[ColBg].pixel : drw->scheme[ColFg].pixel);
-	if (filled)
-		XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
-	else
-		XDrawRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w - 1, h - 1);
+	pixel = invert ? drw->scheme[ColBg].pixel : drw->scheme[ColFg].pixel;
+	if (filled || w < 3 || h < 3) {
+		drw_queue_rect(drw, x, y, w, h, pixel);
+	} else {
+		/* the outline as four filled rectangles */
+		drw_queue_rect(drw, x, y, w, 1, pixel);
+		drw_queue_rect(drw, x, y + h - 1, w, 1, pixel);
+		drw_queue_rect(drw, x, y + 1, 1, h - 2, pixel);
+		drw_queue_rect(drw, x + w - 1, y + 1, 1, h - 2, pixel);
+	}
+}
+
+/* Send the queued frame: rectangles of the same colour that were queued back
+ * to back go out in one XFillRectangles, then the glyphs in one
+ * XftDrawGlyphFontSpec per colour. */
+void
+drw_flush(Drw *drw)
+{
+	unsigned int i, j, k, n;
+	Clr *color;
+
+	if (!drw)
+		return;
+#ifdef SHM
+	if (drw->shm) {
+		/* painted in queue order, so no grouping */
+		for (i = 0; i < drw->nrects; i++)
+			shm_fill(drw, &drw->rects[i], drw->rectpix[i]);
+		for (i = 0; i < drw->nruns; i++)
+			shm_glyphs(drw, &drw->specs[drw->runs[i].first], drw->runs[i].n,
+			           drw->runs[i].color->pixel);
+		drw->nrects = drw->nruns = drw->nspecs = 0;
+		return;
+	}
+#endif
+	for (i = 0; i < drw->nrects; i = j) {
+		for (j = i + 1; j < drw->nrects && drw->rectpix[j] == drw->rectpix[i]; j++)
+			;
+		XSetForeground(drw->dpy, drw->gc, drw->rectpix[i]);
+		XFillRectangles(drw->dpy, drw->drawable, drw->gc, &drw->rects[i], j - i);
+	}
+	for (i = 0; i < drw->nruns; i++) {
+		if (!(color = drw->runs[i].color))
+			continue;
+		for (j = i, n = 0; j < drw->nruns; j++) {
+			if (!drw->runs[j].color || drw->runs[j].color->pixel != color->pixel)
+				continue;
+			for (k = drw->runs[j].first; k < drw->runs[j].first + drw->runs[j].n; k++)
+				if (drw->specs[k].font)
+					drw->specbuf[n++] = drw->specs[k];
+			drw->runs[j].color = NULL;
+		}
+		if (n)
+			XftDrawGlyphFontSpec(drw->xftdraw, color, drw->specbuf, n);
+	}
+	drw->nrects = drw->nruns = drw->nspecs = 0;
+}
+
+void
+drw_glyphs_clear(Drw *drw)
+{
+	if (drw && drw->glyphs)
+		memset(drw->glyphs, 0, (GLYPH_DIRECT + GLYPH_HASHED) * sizeof(Cp));
+#ifdef SHM
+	if (drw && drw->shm)
+		shm_glyphs_clear(drw);
+#endif
 }
 
 int
 drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lpad, const char *text, int invert)
 {
-	int i, ty, ellipsis_x = 0;
+	int ellipsis_x = 0;
 	unsigned int tmpw, ew, ellipsis_w = 0, ellipsis_len;
-	XftDraw *d = NULL;
 	Fnt *usedfont, *curfont, *nextfont;
+	const Cp *glyph;
 	int utf8strlen, utf8charlen, render = x || y || w || h;
 	long utf8codepoint = 0;
 	const char *utf8str;
-	FcCharSet *fccharset;
-	FcPattern *fcpattern;
-	FcPattern *match;
-	XftResult result;
-	int charexists = 0, overflow = 0;
-	/* keep track of a couple codepoints for which we have no match. */
-	enum { nomatches_len = 64 };
-	static struct { long codepoint[nomatches_len]; unsigned int idx; } nomatches;
+	int overflow = 0;
 	const char *ellipsis = "...";
 	static unsigned int ellipsis_width = 0;
 
@@ -267,9 +706,7 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lp
 	if (!render) {
 		w = invert ? invert : ~invert;
 	} else {
-		XSetForeground(drw->dpy, drw->gc, drw->scheme[invert ? ColFg : ColBg].pixel);
-		XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
-		d = XftDrawCreate(drw->dpy, drw->drawable, drw->visual, drw->cmap);
+		drw_queue_rect(drw, x, y, w, h, drw->scheme[invert ? ColFg : ColBg].pixel);
 		x += lpad;
 		w -= lpad;
 	}
@@ -283,107 +720,51 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lp
 		nextfont = NULL;
 		while (*text) {
 			utf8charlen = utf8decode(text, &utf8codepoint, UTF_SIZ);
-			for (curfont = drw->fonts; curfont; curfont = curfont->next) {
-				charexists = charexists || XftCharExists(drw->dpy, curfont->xfont, utf8codepoint);
-				if (charexists) {
-					drw_font_getexts(curfont, text, utf8charlen, &tmpw, NULL);
-					if (ew + ellipsis_width <= w) {
-						/* keep track where the ellipsis still fits */
-						ellipsis_x = x + ew;
-						ellipsis_w = w - ew;
-						ellipsis_len = utf8strlen;
-					}
-
-					if (ew + tmpw > w) {
-						overflow = 1;
-						/* called from drw_fontset_getwidth_clamp():
-						 * it wants the width AFTER the overflow
-						 */
-						if (!render)
-							x += tmpw;
-						else
-							utf8strlen = ellipsis_len;
-					} else if (curfont == usedfont) {
- 						utf8strlen += utf8charlen;
- 						text += utf8charlen;
-						ew += tmpw;
- 					} else {
- 						nextfont = curfont;
- 					}
-					break;
-				}
+			glyph = drw_glyph(drw, utf8codepoint);
+			curfont = glyph->font;
+			tmpw = glyph->w;
+			if (ew + ellipsis_width <= w) {
+				/* keep track where the ellipsis still fits */
+				ellipsis_x = x + ew;
+				ellipsis_w = w - ew;
+				ellipsis_len = utf8strlen;
+			}
+
+			if (ew + tmpw > w) {
+				overflow = 1;
+				/* called from drw_fontset_getwidth_clamp():
+				 * it wants the width AFTER the overflow
+				 */
+				if (!render)
+					x += tmpw;
+				else
+					utf8strlen = ellipsis_len;
+			} else if (curfont == usedfont) {
+				utf8strlen += utf8charlen;
+				text += utf8charlen;
+				ew += tmpw;
+			} else {
+				nextfont = curfont;
 			}
 
-			if (overflow || !charexists || nextfont)
+			if (overflow || nextfont)
 				break;
-			else
-				charexists = 0;
 		}
 
 		if (utf8strlen) {
-			if (render) {
-				ty = y + (h - usedfont->h) / 2 + usedfont->xfont->ascent;
-				XftDrawStringUtf8(d, &drw->scheme[invert ? ColBg : ColFg],
-				                  usedfont->xfont, x, ty, (XftChar8 *)utf8str, utf8strlen);
- 			}
+			if (render)
+				drw_queue_text(drw, usedfont, &drw->scheme[invert ? ColBg : ColFg],
+				               x, y, h, utf8str, utf8strlen);
 			x += ew;
 			w -= ew;
 		}
 		if (render && overflow && ellipsis_w)
 			drw_text(drw, ellipsis_x, y, ellipsis_w, h, 0, ellipsis, invert);
 
-		if (!*text || overflow) {
+		if (!*text || overflow)
 			break;
-		} else if (nextfont) {
-			charexists = 0;
-			usedfont = nextfont;
-		} else {
-			/* Regardless of whether or not a fallback font is found, the
-			 * character must be drawn. */
-			charexists = 1;
-
-			for (i = 0; i < nomatches_len; ++i) {
-				/* avoid calling XftFontMatch if we know we won't find a match */
-				if (utf8codepoint == nomatches.codepoint[i])
-					goto no_match;
-			}
-
-			fccharset = FcCharSetCreate();
-			FcCharSetAddChar(fccharset, utf8codepoint);
-
-			if (!drw->fonts->pattern) {
-				/* Refer to the comment in xfont_create for more information. */
-				die("the first font in the cache must be loaded from a font string.");
-			}
-
-			fcpattern = FcPatternDuplicate(drw->fonts->pattern);
-			FcPatternAddCharSet(fcpattern, FC_CHARSET, fccharset);
-			FcPatternAddBool(fcpattern, FC_SCALABLE, FcTrue);
-
-			FcConfigSubstitute(NULL, fcpattern, FcMatchPattern);
-			FcDefaultSubstitute(fcpattern);
-			match = XftFontMatch(drw->dpy, drw->screen, fcpattern, &result);
-
-			FcCharSetDestroy(fccharset);
-			FcPatternDestroy(fcpattern);
-
-			if (match) {
-				usedfont = xfont_create(drw, NULL, match);
-				if (usedfont && XftCharExists(drw->dpy, usedfont->xfont, utf8codepoint)) {
-					for (curfont = drw->fonts; curfont->next; curfont = curfont->next)
-						; /* NOP */
-					curfont->next = usedfont;
-				} else {
-					xfont_free(usedfont);
-					nomatches.codepoint[++nomatches.idx % nomatches_len] = utf8codepoint;
-no_match:
-					usedfont = drw->fonts;
-				}
-			}
-		}
+		usedfont = nextfont;
 	}
-	if (d)
-		XftDrawDestroy(d);
 
 	return x + (render ? w : 0);
 }
@@ -394,8 +775,64 @@ drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h)
 	if (!drw)
 		return;
 
+	drw_flush(drw);
+	/* the server answers with a NoExpose, or a ShmCompletion, once the
+	 * copy is done, which drw_fence() and drw_fenced() account for; no
+	 * round-trip here */
+#ifdef SHM
+	if (drw->shm)
+		XShmPutImage(drw->dpy, win, drw->gc, drw->shm->img, x, y, x, y, w, h, True);
+	else
+#endif
 	XCopyArea(drw->dpy, drw->drawable, win, drw->gc, x, y, w, h, x, y);
-	XSync(drw->dpy, False);
+	drw->inflight++;
+	XFlush(drw->dpy);
+}
+
+static int
+isfence(Drw *drw, XEvent *ev)
+{
+#ifdef SHM
+	if (drw->shm && ev->type == drw->shm->completion)
+		return 1;
+#endif
+	return ev->type == NoExpose
+	    || (ev->type == GraphicsExpose && !ev->xgraphicsexpose.count);
+}
+
+static Bool
+isfencefor(Display *dpy, XEvent *ev, XPointer arg)
+{
+	Drw *drw = (Drw *)arg;
+
+	/* NoExpose, GraphicsExpose and ShmCompletion all start with the drawable */
+	return isfence(drw, ev) && ev->xnoexpose.drawable == drw->fencewin;
+}
+
+/* Wait for the copies of earlier frames, so no more than one frame is ever
+ * queued on the server, nor the shared image drawn into while the server
+ * still reads it. Other events stay in the queue. */
+void
+drw_fence(Drw *drw, Window win)
+{
+	XEvent ev;
+
+	if (!drw)
+		return;
+	drw->fencewin = win;
+	while (drw->inflight > 0) {
+		XIfEvent(drw->dpy, &ev, isfencefor, (XPointer)drw);
+		drw->inflight--;
+	}
+}
+
+/* account for a completed copy read by the event loop; other events are
+ * ignored */
+void
+drw_fenced(Drw *drw, XEvent *ev)
+{
+	if (drw && drw->inflight > 0 && isfence(drw, ev))
+		drw->inflight--;
 }
 
 unsigned int
@@ -415,6 +852,25 @@ drw_fontset_getwidth_clamp(Drw *drw, const char *text, unsigned int n)
 	return MIN(n, tmp);
 }
 
+/* adv[i] is the pen position before byte i of text; bytes inside a
+ * character share the position of its first byte, adv[len] is the width */
+void
+drw_text_advances(Drw *drw, const char *text, unsigned int len, unsigned int *adv)
+{
+	unsigned int i = 0, n, x = 0;
+	long utf8codepoint;
+
+	if (!drw || !drw->fonts || !text)
+		return;
+	while (i < len && (n = utf8decode(text + i, &utf8codepoint, MIN(len - i, UTF_SIZ)))) {
+		for (n += i; i < n; i++)
+			adv[i] = x;
+		x += drw_glyph(drw, utf8codepoint)->w;
+	}
+	for (; i <= len; i++)
+		adv[i] = x;
+}
+
 void
 drw_font_getexts(Fnt *font, const char *text, unsigned int len, unsigned int *w, unsigned int *h)
 {
@@ -454,3 +910,7 @@ drw_cur_free(Drw *drw, Cur *cursor)
 }
 
 #include "patch/scroll.c"
+#include "patch/fontcache.c"
+#ifdef SHM
+#include "patch/shm.c"
+#endif
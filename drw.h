@@ -8,14 +8,34 @@ typedef struct {
 typedef struct Fnt {
 	Display *dpy;
 	unsigned int h;
-	XftFont *xfont;
+	XftFont *xfont; /* NULL until the first codepoint needing it */
 	FcPattern *pattern;
+	FcPattern *match; /* resolved pattern to open, owned until then */
+	FcCharSet *charset; /* coverage of match */
 	struct Fnt *next;
 } Fnt;
 
 enum { ColFg, ColBg }; /* Clr scheme index */
 typedef XftColor Clr;
 
+typedef struct {
+	long codepoint;
+	Fnt *font; /* NULL if the slot is unused */
+	unsigned int w;
+	FT_UInt glyph;
+} Cp;
+
+typedef struct {
+	XRectangle box; /* cell the run was laid out in */
+	Clr *color;
+	unsigned int first, n; /* glyphs in the frame batch */
+} Run;
+
+
+#ifdef SHM
+typedef struct Shm Shm;
+#endif
+
 typedef struct {
 	unsigned int w, h;
 	Display *dpy;
@@ -25,9 +45,25 @@ typedef struct {
 	unsigned int depth;
 	Colormap cmap;
 	Drawable drawable;
+	XftDraw *xftdraw; /* bound to drawable, follows drw_resize() */
 	GC gc;
+	unsigned int inflight; /* copies to windows not yet completed */
+	Window fencewin;
+#ifdef SHM
+	Shm *shm; /* client side rendering, NULL if MIT-SHM is unusable */
+#endif
 	Clr *scheme;
 	Fnt *fonts;
+	Cp *glyphs; /* codepoint to font and advance cache */
+	/* frame batch, drawn by drw_flush() */
+	XRectangle *rects;
+	unsigned long *rectpix;
+	unsigned int nrects, rectcap;
+	Run *runs;
+	unsigned int nruns, runcap;
+	XftGlyphFontSpec *specs, *specbuf;
+	unsigned short *specw;
+	unsigned int nspecs, speccap;
 } Drw;
 
 /* Drawable abstraction */
@@ -40,7 +76,9 @@ Fnt *drw_fontset_create(Drw* drw, const char *fonts[], size_t fontcount);
 void drw_fontset_free(Fnt* set);
 unsigned int drw_fontset_getwidth(Drw *drw, const char *text);
 unsigned int drw_fontset_getwidth_clamp(Drw *drw, const char *text, unsigned int n);
+void drw_text_advances(Drw *drw, const char *text, unsigned int len, unsigned int *adv);
 void drw_font_getexts(Fnt *font, const char *text, unsigned int len, unsigned int *w, unsigned int *h);
+void drw_glyphs_clear(Drw *drw);
 
 /* Colorscheme abstraction */
 void drw_clr_create(Drw *drw, Clr *dest, const char *clrname, unsigned int alpha);
@@ -59,6 +97,9 @@ void drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled
 int drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned int lpad, const char *text, int invert);
 
 /* Map functions */
+void drw_flush(Drw *drw);
 void drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h);
+void drw_fence(Drw *drw, Window win);
+void drw_fenced(Drw *drw, XEvent *ev);
 
 #include "patch/scroll.h"
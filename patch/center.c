@@ -1,8 +1,48 @@
+/* Widest item, as TEXTW(item->text). Items with a non-ASCII or control
+ * byte other than tab are measured, a printable ASCII item of n bytes is at
+ * most n times the widest printable advance, so of those only the ones that
+ * could still be wider than the longest one are. For a monospace font that
+ * is the longest one alone. */
 static int
 max_textw(void)
 {
-	int len = 0;
-	for (struct item *item = items; item && item->text; item++)
-		len = MAX(TEXTW(item->text), len);
-	return len;
+	/* tab and 0x20-0x7e; control bytes would each go through the fallback
+	 * font search on a cold cache */
+	static char ascii[1 + 0x7e - 0x20 + 1];
+	unsigned int adv[sizeof ascii];
+	unsigned int maxadv = 0, w, best = 0;
+	size_t i, n, *len, longest = 0;
+	const char *p;
+	int other;
+
+	ascii[0] = '\t';
+	for (i = 1; i < LENGTH(ascii) - 1; i++)
+		ascii[i] = 0x20 + i - 1;
+	drw_text_advances(drw, ascii, LENGTH(ascii) - 1, adv);
+	for (i = 0; i < LENGTH(ascii) - 1; i++)
+		maxadv = MAX(maxadv, adv[i + 1] - adv[i]);
+
+	for (n = 0; items && items[n].text; n++)
+		;
+	if (!n)
+		return 0;
+	len = ecalloc(n, sizeof *len);
+	for (i = 0; i < n; i++) {
+		for (p = items[i].text, other = 0; *p; p++)
+			other |= *p != '\t' && (*p < 0x20 || *p > 0x7e);
+		len[i] = p - items[i].text;
+		if (other) {
+			best = MAX(best, itemw(&items[i]));
+			len[i] = 0; /* done */
+		} else if (len[i] >= len[longest]) {
+			longest = i;
+		}
+	}
+	best = MAX(best, itemw(&items[longest]));
+	for (i = 0; i < n; i++)
+		if (len[i] * maxadv + lrpad > best && (w = itemw(&items[i])) > best)
+			best = w;
+
+	free(len);
+	return best;
 }
@@ -0,0 +1,76 @@
+/* the next frame is drawn in full, e.g. because the items were replaced */
+static void
+damageall(void)
+{
+	drawncolumns = -1;
+}
+
+/* whether the whole window has to be drawn: first frame, or the geometry
+ * changed; resets the retained state for the given number of row slots */
+static int
+damagefull(int slots)
+{
+	if (drawncolumns == columns && drawnlines == lines
+	&& drawnw == mw && drawnh == mh && rowstaten == slots)
+		return 0;
+	drawnw = mw;
+	drawnh = mh;
+	drawnlines = lines;
+	drawncolumns = columns;
+	if (slots > rowstaten && !(rowstates = realloc(rowstates, slots * sizeof *rowstates)))
+		die("cannot realloc %u bytes:", slots * sizeof *rowstates);
+	rowstaten = slots;
+	if (slots)
+		memset(rowstates, 0, slots * sizeof *rowstates);
+	drawntext[0] = drawnnumbers[0] = '\0';
+	drawncursor = 0;
+	return 1;
+}
+
+/* whether the prompt, input field or counter changed since the last frame */
+static int
+damagebar(void)
+{
+	textdamaged = strcmp(drawntext, text) != 0;
+	if (!textdamaged && drawncursor == cursor && !strcmp(drawnnumbers, numbers))
+		return 0;
+	strcpy(drawntext, text);
+	strcpy(drawnnumbers, numbers);
+	drawncursor = cursor;
+	return 1;
+}
+
+static unsigned int
+spanhash(struct item *item)
+{
+	struct span sp[64];
+	unsigned int h = 2166136261U;
+	int i, n = queryspans(item, sp, LENGTH(sp));
+
+	for (i = 0; i < n; i++)
+		h = ((h ^ sp[i].start) * 16777619U ^ sp[i].end) * 16777619U;
+	return h;
+}
+
+/* whether row slot i changed since the last frame; with a new query a row
+ * keeping its item only changes if its highlights do */
+static int
+damagerow(int i, struct item *item)
+{
+	struct rowstate *r = &rowstates[i];
+	int rsel = item && item == sel, out = item && issel(item->id);
+	int hover = item && item == hovered;
+	unsigned int spans = r->spans;
+
+	if (item && (textdamaged || item != r->item))
+		spans = spanhash(item);
+	if (r->item == item && r->sel == rsel && r->hover == hover
+	&& r->out == out && r->spans == spans)
+		return 0;
+	r->item = item;
+	r->sel = rsel;
+	r->hover = hover;
+	r->out = out;
+	r->spans = spans;
+	return 1;
+}
@@ -0,0 +1,19 @@
+struct rowstate {
+	struct item *item; /* drawn in this slot, NULL if the slot is empty */
+	int sel;           /* item == sel */
+	int hover;         /* item == hovered */
+	int out;           /* issel(item->id) */
+	unsigned int spans; /* hash of the highlighted spans */
+};
+
+static struct rowstate *rowstates;
+static int rowstaten;
+static int drawnw, drawnh, drawnlines, drawncolumns = -1; /* -1: nothing drawn yet */
+static char drawntext[sizeof text], drawnnumbers[NUMBERSBUFSIZE];
+static size_t drawncursor;
+static int textdamaged;
+
+static void damageall(void);
+static int damagefull(int slots);
+static int damagebar(void);
+static int damagerow(int i, struct item *item);
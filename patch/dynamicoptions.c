@@ -21,9 +21,13 @@ static void
 readstream(FILE* stream)
 {
 	char buf[sizeof text], *p;
-	size_t i, imax = 0, size = 0;
-	unsigned int tmpmax = 0;
+	size_t i, size = 0;
 
+	layoutinvalidate();
+	damageall();
+	/* both point into items, which is about to be reallocated */
+	nhits = 0;
+	hovered = NULL;
 	/* read each line from stdin and add it to the item list */
 	for (i = 0; fgets(buf, sizeof buf, stream); i++) {
 		if (i + 1 >= size / sizeof *items)
@@ -33,6 +37,7 @@ readstream(FILE* stream)
 			*p = '\0';
 		if (!(items[i].text = strdup(buf)))
 			die("cannot strdup %u bytes:", strlen(buf) + 1);
+		items[i].weight = weighted ? readweight(items[i].text) : 0;
 		if (separator && (p = separator_greedy ?
 			strrchr(items[i].text, separator) : strchr(items[i].text, separator))) {
 			*p = '\0';
@@ -47,11 +52,10 @@ readstream(FILE* stream)
 		}
 		items[i].id = i;
 		items[i].hp = arrayhas(hpitems, hplength, items[i].text);
-		drw_font_getexts(drw->fonts, buf, strlen(buf), &tmpmax, NULL);
-		if (tmpmax > inputw) {
-			inputw = tmpmax;
-			imax = i;
-		}
+		nthspan(&items[i]);
+		items[i].chars = charmask(items[i].text);
+		items[i].bounds = wordstarts(items[i].text + items[i].mstart, items[i].mlen);
+		itemstyle(&items[i]);
 	}
 
 	/* If the command did not give any output at all, then do not clear the existing items */
@@ -60,7 +64,9 @@ readstream(FILE* stream)
 
 	if (items)
 		items[i].text = NULL;
-	inputw = items ? TEXTW(items[imax].text) : 0;
+	nitems = i;
+	weightorder();
+	inputw = max_textw();
 	if (!dynamic || !*dynamic)
 		lines = MIN(lines, i);
 	else {
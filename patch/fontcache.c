@@ -0,0 +1,255 @@
+static unsigned long long
+fnv(unsigned long long h, const void *p, size_t len)
+{
+	const unsigned char *s = p;
+
+	while (len--)
+		h = (h ^ *s++) * 1099511628211ULL;
+	return h;
+}
+
+/* the cache is only valid for the same primary font, fontconfig version
+ * and font directories as when it was written */
+static unsigned long long
+fontcache_key(Drw *drw)
+{
+	unsigned long long h = 14695981039346656037ULL;
+	FcChar8 *name, *dir;
+	FcStrList *dirs;
+	struct stat st;
+	int version = FcGetVersion();
+
+	if ((name = FcNameUnparse(drw->fonts->pattern))) {
+		h = fnv(h, name, strlen((char *)name));
+		free(name);
+	}
+	h = fnv(h, &version, sizeof version);
+	if ((dirs = FcConfigGetFontDirs(NULL))) {
+		while ((dir = FcStrListNext(dirs))) {
+			h = fnv(h, dir, strlen((char *)dir));
+			if (!stat((char *)dir, &st))
+				h = fnv(h, &st.st_mtime, sizeof st.st_mtime);
+		}
+		FcStrListDone(dirs);
+	}
+	return h;
+}
+
+static char *
+fontcache_path(void)
+{
+	static char path[PATH_MAX];
+	const char *dir;
+
+	if ((dir = getenv("XDG_CACHE_HOME")) && *dir)
+		snprintf(path, sizeof path, "%s/dmenu/fallbacks", dir);
+	else if ((dir = getenv("HOME")))
+		snprintf(path, sizeof path, "%s/.cache/dmenu/fallbacks", dir);
+	else
+		return NULL;
+	return path;
+}
+
+static void
+fontcache_insert(size_t i, long lo, long hi, const char *file, int index)
+{
+	if (fallbackn == fallbacksize) {
+		fallbacksize = fallbacksize ? fallbacksize * 2 : 64;
+		if (!(fallbacks = realloc(fallbacks, fallbacksize * sizeof *fallbacks)))
+			die("cannot realloc %zu bytes:", fallbacksize * sizeof *fallbacks);
+	}
+	memmove(&fallbacks[i + 1], &fallbacks[i], (fallbackn++ - i) * sizeof *fallbacks);
+	fallbacks[i].lo = lo;
+	fallbacks[i].hi = hi;
+	fallbacks[i].file = NULL;
+	if (file && !(fallbacks[i].file = strdup(file)))
+		die("cannot strdup %zu bytes:", strlen(file) + 1);
+	fallbacks[i].index = index;
+}
+
+/* index of the first range not below cp */
+static size_t
+fontcache_find(long cp)
+{
+	size_t lo = 0, hi = fallbackn, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (fallbacks[mid].hi < cp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void
+fontcache_load(Drw *drw)
+{
+	char line[PATH_MAX + 64], *path, *file, *p;
+	unsigned long long key;
+	unsigned long lo, hi;
+	int index, n;
+	FILE *fp;
+
+	fallbacksloaded = 1;
+	fallbackkey = fontcache_key(drw);
+	if (!(path = fontcache_path()) || !(fp = fopen(path, "r")))
+		return;
+	if (!fgets(line, sizeof line, fp) || sscanf(line, "dmenu-fallbacks %llx", &key) != 1
+	|| key != fallbackkey) {
+		/* fonts changed, start over */
+		fclose(fp);
+		return;
+	}
+	/* lo hi index file, sorted; "-" for no font */
+	while (fgets(line, sizeof line, fp)) {
+		if (sscanf(line, "%lx %lx %d %n", &lo, &hi, &index, &n) != 3 || lo > hi
+		|| (fallbackn && (long)lo <= fallbacks[fallbackn - 1].hi))
+			break;
+		file = line + n;
+		if ((p = strchr(file, '\n')))
+			*p = '\0';
+		fontcache_insert(fallbackn, lo, hi, strcmp(file, "-") ? file : NULL, index);
+	}
+	fclose(fp);
+}
+
+static const struct fallback *
+fontcache_lookup(Drw *drw, long cp)
+{
+	size_t i;
+
+	if (!fallbacksloaded)
+		fontcache_load(drw);
+	i = fontcache_find(cp);
+	return i < fallbackn && fallbacks[i].lo <= cp ? &fallbacks[i] : NULL;
+}
+
+/* open the cached font like XftFontMatch would have resolved it, but with
+ * the font's pattern taken from the fontconfig cache instead of a match
+ * against every installed font */
+static Fnt *
+fontcache_open(Drw *drw, const struct fallback *fb)
+{
+	FcPattern *pattern, *query, *match = NULL;
+	FcFontSet *fs;
+	Fnt *font = NULL;
+
+	query = FcPatternBuild(NULL, FC_FILE, FcTypeString, fb->file,
+	                       FC_INDEX, FcTypeInteger, fb->index, (char *)NULL);
+	fs = FcFontList(NULL, query, NULL);
+	FcPatternDestroy(query);
+	if (fs && fs->nfont) {
+		pattern = FcPatternDuplicate(drw->fonts->pattern);
+		FcPatternAddBool(pattern, FC_SCALABLE, FcTrue);
+		FcConfigSubstitute(NULL, pattern, FcMatchPattern);
+		XftDefaultSubstitute(drw->dpy, drw->screen, pattern);
+		match = FcFontRenderPrepare(NULL, pattern, fs->fonts[0]);
+		FcPatternDestroy(pattern);
+	}
+	if (fs)
+		FcFontSetDestroy(fs);
+	if (match && !(font = xfont_create(drw, NULL, match)))
+		FcPatternDestroy(match);
+	return font;
+}
+
+static int
+samefont(const struct fallback *fb, const char *file, int index)
+{
+	return fb->file ? file && index == fb->index && !strcmp(fb->file, file) : !file;
+}
+
+/* remember the font resolved for cp, NULL if there is none */
+static void
+fontcache_add(long cp, FcPattern *match)
+{
+	FcChar8 *file = NULL;
+	int index = 0;
+	size_t i;
+	struct fallback *fb;
+
+	if (match && FcPatternGetString(match, FC_FILE, 0, &file) == FcResultMatch)
+		FcPatternGetInteger(match, FC_INDEX, 0, &index);
+	else
+		file = NULL;
+
+	/* cut cp out of a stale range */
+	i = fontcache_find(cp);
+	if (i < fallbackn && (fb = &fallbacks[i])->lo <= cp) {
+		if (samefont(fb, (char *)file, index))
+			return;
+		if (fb->lo == fb->hi) {
+			free(fb->file);
+			memmove(fb, fb + 1, (--fallbackn - i) * sizeof *fb);
+		} else if (fb->lo == cp) {
+			fb->lo++;
+		} else if (fb->hi == cp) {
+			fb->hi--;
+			i++;
+		} else {
+			fontcache_insert(i + 1, cp + 1, fallbacks[i].hi, fallbacks[i].file, fallbacks[i].index);
+			fallbacks[i].hi = cp - 1;
+			i++;
+		}
+	}
+	fallbacksdirty = 1;
+	/* grow a neighbouring range of the same font, or start one */
+	if (i > 0 && fallbacks[i - 1].hi == cp - 1 && samefont(&fallbacks[i - 1], (char *)file, index)) {
+		fallbacks[i - 1].hi = cp;
+		if (i < fallbackn && fallbacks[i].lo == cp + 1
+		&& samefont(&fallbacks[i], (char *)file, index)) {
+			fallbacks[i - 1].hi = fallbacks[i].hi;
+			free(fallbacks[i].file);
+			memmove(&fallbacks[i], &fallbacks[i + 1], (--fallbackn - i) * sizeof *fallbacks);
+		}
+	} else if (i < fallbackn && fallbacks[i].lo == cp + 1
+	&& samefont(&fallbacks[i], (char *)file, index)) {
+		fallbacks[i].lo = cp;
+	} else {
+		fontcache_insert(i, cp, cp, (char *)file, index);
+	}
+}
+
+static void
+fontcache_write(void)
+{
+	char *path, *p, tmp[PATH_MAX];
+	size_t i;
+	FILE *fp;
+
+	if (!(path = fontcache_path()))
+		return;
+	/* mkdir -p, failures show up in fopen */
+	for (p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		mkdir(path, 0755);
+		*p = '/';
+	}
+	snprintf(tmp, sizeof tmp, "%s.%d", path, (int)getpid());
+	if (!(fp = fopen(tmp, "w")))
+		return;
+	fprintf(fp, "dmenu-fallbacks %016llx\n", fallbackkey);
+	for (i = 0; i < fallbackn; i++)
+		fprintf(fp, "%lx %lx %d %s\n", fallbacks[i].lo, fallbacks[i].hi,
+		        fallbacks[i].index, fallbacks[i].file ? fallbacks[i].file : "-");
+	/* replace the old cache in one step, concurrent runs may be reading */
+	if (fclose(fp) || rename(tmp, path))
+		unlink(tmp);
+}
+
+/* write the cache back if anything was resolved this run */
+static void
+fontcache_save(void)
+{
+	size_t i;
+
+	if (fallbacksdirty)
+		fontcache_write();
+	for (i = 0; i < fallbackn; i++)
+		free(fallbacks[i].file);
+	free(fallbacks);
+	fallbacks = NULL;
+	fallbackn = fallbacksize = fallbacksdirty = fallbacksloaded = 0;
+}
@@ -0,0 +1,16 @@
+/* codepoints resolved to a fallback font, kept across runs */
+struct fallback {
+	long lo, hi; /* codepoint range */
+	char *file;  /* NULL if no font covers the range */
+	int index;   /* face in file */
+};
+
+static struct fallback *fallbacks;
+static size_t fallbackn, fallbacksize;
+static int fallbacksloaded, fallbacksdirty;
+static unsigned long long fallbackkey;
+
+static const struct fallback *fontcache_lookup(Drw *drw, long cp);
+static Fnt *fontcache_open(Drw *drw, const struct fallback *fb);
+static void fontcache_add(long cp, FcPattern *match);
+static void fontcache_save(void);
@@ -1,40 +1,50 @@
 static void
 drawhighlights(struct item *item, char *output, int x, int y, int maxw)
 {
-	int i, indent;
-	char *highlight;
-	char c;
+	static struct span spans[64];
+	static unsigned int *adv;
+	static size_t advsize;
+	char *itemtext = output, c;
+	int i, n, s, e, off, len;
 
-	char *itemtext = output;
-
-	if (!(strlen(itemtext) && strlen(text)))
+	if (!(*itemtext && *text))
+		return;
+	/* spans are offsets into the -nth fields, itemtext may skip markup */
+	if (itemtext < item->text || itemtext > item->text + item->mstart + item->mlen)
+		return;
+	if (!(n = queryspans(item, spans, LENGTH(spans))))
+		return;
+	off = itemtext - (item->text + item->mstart);
+	if ((len = MIN((int)strlen(itemtext), (int)spans[n - 1].end - off)) <= 0)
 		return;
 
+	/* measure once, every run is placed from the cumulative advances */
+	if ((size_t)len + 1 > advsize) {
+		advsize = len + 1;
+		if (!(adv = realloc(adv, advsize * sizeof *adv)))
+			die("cannot realloc %u bytes:", advsize * sizeof *adv);
+	}
+	drw_text_advances(drw, itemtext, len, adv);
+
 	drw_setscheme(drw, scheme[item == sel
 	                   ? SchemeSelHighlight
 	                   : SchemeNormHighlight]);
-	for (i = 0, highlight = itemtext; *highlight && text[i];) {
-		if (!fstrncmp(&(*highlight), &text[i], 1))
-		{
-			/* get indentation */
-			c = *highlight;
-			*highlight = '\0';
-			indent = TEXTW(itemtext) - lrpad;
-			*highlight = c;
-
-			/* highlight character */
-			c = highlight[1];
-			highlight[1] = '\0';
-			drw_text(
-				drw,
-				x + indent + (lrpad / 2),
-				y,
-				MIN(maxw - indent - lrpad, TEXTW(highlight) - lrpad),
-				bh, 0, highlight, 0
-			);
-			highlight[1] = c;
-			i++;
-		}
-		highlight++;
+	for (i = 0; i < n; i++) {
+		s = MAX((int)spans[i].start - off, 0);
+		e = MIN((int)spans[i].end - off, len);
+		if (s >= e)
+			continue;
+		if ((int)adv[s] >= maxw - lrpad)
+			break;
+		c = itemtext[e];
+		itemtext[e] = '\0';
+		drw_text(
+			drw,
+			x + adv[s] + (lrpad / 2),
+			y,
+			MIN(maxw - (int)adv[s] - lrpad, (int)(adv[e] - adv[s])),
+			bh, 0, itemtext + s, 0
+		);
+		itemtext[e] = c;
 	}
 }
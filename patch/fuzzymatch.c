@@ -11,7 +11,57 @@ compare_distance(const void *a, const void *b)
 	if (!da)
 		return -1;
 
-	return da->distance == db->distance ? 0 : da->distance < db->distance ? -1 : 1;
+	if (da->distance == db->distance)
+		return da->id - db->id;
+	return da->distance < db->distance ? -1 : 1;
+}
+
+/* fuzzy match pat against the first len bytes of s, scoring the match; the
+ * offsets of the matched bytes go to pos unless it is NULL */
+static int
+fuzzyscore(const char *s, size_t len, unsigned long long bounds,
+           const char *pat, size_t plen, double *dist, int *pos)
+{
+	char c;
+	size_t i, pidx = 0; /* pointer */
+	int sidx = -1, eidx = -1; /* start of match, end of match */
+	int nb = 0; /* word starts hit */
+	double d;
+
+	/* walk through item text */
+	for (i = 0; i < len && (c = s[i]); i++) {
+		/* fuzzy match pattern */
+		if (!fstrncmp(&pat[pidx], &c, 1)) {
+			if (sidx == -1)
+				sidx = i;
+			if (ISWORDSTART(bounds, i))
+				nb++;
+			if (pos)
+				pos[pidx] = i;
+			pidx++;
+			if (pidx == plen) {
+				eidx = i;
+				break;
+			}
+		}
+	}
+	if (eidx == -1)
+		return 0;
+	/* compute distance */
+	/* add penalty if match starts late (log(sidx+2))
+	 * add penalty for long a match without many matching characters
+	 * add bonus for every character matching at the start of a word */
+	*dist = log(sidx + 2) + (double)(eidx - sidx - (int)plen) - BOUNDARYBONUS * nb;
+	/* entering every word at its start may beat the leftmost match */
+	if ((nb = acronym(s, len, bounds, pat, plen, &sidx, &eidx, NULL))) {
+		d = log(sidx + 2) + (double)(eidx - sidx - (int)plen) - BOUNDARYBONUS * nb;
+		if (d < *dist) {
+			*dist = d;
+			if (pos)
+				acronym(s, len, bounds, pat, plen, &sidx, &eidx, pos);
+		}
+	}
+	return 1;
 }
 
 void
@@ -20,48 +70,28 @@ fuzzymatch(void)
 	/* bang - we have so much memory */
 	struct item *it;
 	struct item **fuzzymatches = NULL;
-	char c;
-	int number_of_matches = 0, i, pidx, sidx, eidx;
-	int text_len = strlen(text), itext_len;
+	int number_of_matches = 0, i;
 	struct item *lhpprefix, *hpprefixend;
 	lhpprefix = hpprefixend = NULL;
 	matches = matchend = NULL;
 
+	compilequery();
+	typoreset();
 	/* walk through all items */
 	for (it = items; it && it->text; it++) {
-		if (text_len) {
-			itext_len = strlen(it->text);
-			pidx = 0; /* pointer */
-			sidx = eidx = -1; /* start of match, end of match */
-			/* walk through item text */
-			for (i = 0; i < itext_len && (c = it->text[i]); i++) {
-				/* fuzzy match pattern */
-				if (!fstrncmp(&text[pidx], &c, 1)) {
-					if (sidx == -1)
-						sidx = i;
-					pidx++;
-					if (pidx == text_len) {
-						eidx = i;
-						break;
-					}
-				}
-			}
-			/* build list of matches */
-			if (eidx != -1) {
-				/* compute distance */
-				/* add penalty if match starts late (log(sidx+2))
-				 * add penalty for long a match without many matching characters */
-				it->distance = log(sidx + 2) + (double)(eidx - sidx - text_len);
-				/* fprintf(stderr, "distance %s %f\n", it->text, it->distance); */
-				appenditem(it, &matches, &matchend);
-				number_of_matches++;
-			}
-		} else {
-			appenditem(it, &matches, &matchend);
+		it->distance = 0;
+		if (qtermn && !querymatch(it, &it->distance)) {
+			typocandidate(it);
+			continue;
 		}
+		/* build list of matches, producer supplied weights lower the distance */
+		it->distance -= it->weight;
+		/* fprintf(stderr, "distance %s %f\n", it->text, it->distance); */
+		appenditem(it, &matches, &matchend);
+		number_of_matches++;
 	}
 
-	if (number_of_matches) {
+	if (number_of_matches && (qtermn || weighted)) {
 		/* initialize array with matches */
 		if (!(fuzzymatches = realloc(fuzzymatches, number_of_matches * sizeof(struct item*))))
 			die("cannot realloc %u bytes:", number_of_matches * sizeof(struct item*));
@@ -85,8 +115,16 @@ fuzzymatch(void)
 	}
 	if (lhpprefix) {
 		hpprefixend->right = matches;
+		if (matches)
+			matches->left = hpprefixend;
+		else
+			matchend = hpprefixend;
 		matches = lhpprefix;
 	}
+	/* items within a few typos go last, and only if little else matched */
+	if (qtermn && number_of_matches < typo_threshold)
+		typotier(&matches, &matchend);
 	curr = sel = matches;
+	matchindex();
 	calcoffsets();
 }
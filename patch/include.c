@@ -1,11 +1,22 @@
 #include "center.c"
+#include "wordstarts.c"
 #include "fuzzyhighlight.c"
 #include "fuzzymatch.c"
 #include "fzfexpect.c"
 #include "highpriority.c"
+#include "layoutcache.c"
 #include "dynamicoptions.c"
 #include "multiselect.c"
 #include "mousesupport.c"
 #include "navhistory.c"
+#include "nth.c"
 #include "numbers.c"
+#include "query.c"
+#include "rankweights.c"
+#include "typo.c"
+#include "damage.c"
+#include "inputadv.c"
 #include "xresources.c"
+#include "ingest.c"
+#include "timing.c"
+#include "xqueries.c"
@@ -2,3 +2,14 @@
 #include "fzfexpect.h"
 #include "highpriority.h"
 #include "numbers.h"
+#include "query.h"
+#include "typo.h"
+#include "rankweights.h"
+#include "wordstarts.h"
+#include "nth.h"
+#include "layoutcache.h"
+#include "damage.h"
+#include "inputadv.h"
+#include "mousesupport.h"
+#include "timing.h"
+#include "xqueries.h"
@@ -0,0 +1,32 @@
+static pthread_t ingestthread;
+static int ingesting;
+
+static void *
+ingest(void *arg)
+{
+	loadhistory();
+	if (!(dynamic && *dynamic))
+		readstdin();
+	return NULL;
+}
+
+/* read the history and stdin while the main thread sets up X; nothing
+ * may look at items, lines or history until ingestwait() */
+static void
+ingeststart(void)
+{
+	if (pthread_create(&ingestthread, NULL, ingest, NULL))
+		ingest(NULL);
+	else
+		ingesting = 1;
+}
+
+static void
+ingestwait(void)
+{
+	if (!ingesting)
+		return;
+	if ((errno = pthread_join(ingestthread, NULL)))
+		die("pthread_join:");
+	ingesting = 0;
+}
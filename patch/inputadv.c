@@ -0,0 +1,56 @@
+/* Only the bytes from the first change on are measured again, which for
+ * typing and deleting at the end of the input is one character. */
+static const unsigned int *
+inputadvances(const char *s, size_t len)
+{
+	size_t i, j;
+	unsigned int base;
+
+	for (i = 0; i < inputvalid && i < len && s[i] == inputmeasured[i]; i++)
+		;
+	/* back to the start of the character the change is in */
+	while (i > 0 && (s[i] & 0xc0) == 0x80)
+		i--;
+	base = inputadv[i];
+	drw_text_advances(drw, s + i, len - i, inputadv + i);
+	for (j = i; j <= len; j++)
+		inputadv[j] += base;
+	memcpy(inputmeasured + i, s + i, len - i);
+	inputvalid = len;
+	return inputadv;
+}
+
+/* first byte of what fits in w pixels left of byte cur */
+static size_t
+inputleft(const unsigned int *adv, size_t cur, unsigned int w)
+{
+	size_t lo = 0, hi = cur, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (adv[cur] - adv[mid] > w)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* end of what fits in w pixels right of byte cur */
+static size_t
+inputright(const char *s, const unsigned int *adv, size_t cur, size_t len, unsigned int w)
+{
+	size_t lo = cur, hi = len, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (adv[mid] - adv[cur] <= w)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	/* bytes inside a character share its start position */
+	while (lo > cur && (s[lo] & 0xc0) == 0x80)
+		lo--;
+	return lo;
+}
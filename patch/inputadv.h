@@ -0,0 +1,8 @@
+/* cumulative advances of the input field, see drw_text_advances() */
+static unsigned int inputadv[sizeof text + 1];
+static char inputmeasured[sizeof text]; /* the string inputadv belongs to */
+static size_t inputvalid; /* bytes of inputmeasured inputadv is valid for */
+
+static const unsigned int *inputadvances(const char *s, size_t len);
+static size_t inputleft(const unsigned int *adv, size_t cur, unsigned int w);
+static size_t inputright(const char *s, const unsigned int *adv, size_t cur, size_t len, unsigned int w);
@@ -0,0 +1,56 @@
+static void
+layoutinvalidate(void)
+{
+	/* items were reloaded or the fonts changed */
+	if (!++layoutgen)
+		layoutgen = 1;
+}
+
+static struct layout *
+layoutget(struct item *item)
+{
+	size_t size;
+
+	if (item->id >= layoutsize) {
+		size = MAX(layoutsize * 2, item->id + BUFSIZ);
+		if (!(layouts = realloc(layouts, size * sizeof *layouts)))
+			die("cannot realloc %u bytes:", size * sizeof *layouts);
+		memset(layouts + layoutsize, 0, (size - layoutsize) * sizeof *layouts);
+		layoutsize = size;
+	}
+	if (layouts[item->id].gen != layoutgen) {
+		layouts[item->id].gen = layoutgen;
+		layouts[item->id].w = layouts[item->id].min = 0;
+	}
+	return &layouts[item->id];
+}
+
+/* same as TEXTW(item->text) */
+static unsigned int
+itemw(struct item *item)
+{
+	struct layout *l = layoutget(item);
+
+	if (!l->w)
+		l->w = l->min = TEXTW(item->text);
+	return l->w;
+}
+
+/* same as textw_clamp(item->text, n), measuring the text only once for
+ * every width it is clamped to */
+static unsigned int
+itemw_clamp(struct item *item, unsigned int n)
+{
+	struct layout *l = layoutget(item);
+	unsigned int w;
+
+	if (l->w)
+		return MIN(l->w, n);
+	if (l->min >= n)
+		return n;
+	/* narrower than n means nothing was cut off */
+	if ((w = textw_clamp(item->text, n)) < n)
+		l->w = w;
+	l->min = MAX(l->min, w);
+	return w;
+}
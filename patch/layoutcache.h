@@ -0,0 +1,13 @@
+struct layout {
+	unsigned int gen; /* entry is stale unless it matches layoutgen */
+	unsigned int w;   /* TEXTW(item->text), when exact */
+	unsigned int min; /* TEXTW(item->text) is at least this */
+};
+
+static struct layout *layouts;
+static size_t layoutsize;
+static unsigned int layoutgen = 1;
+
+static void layoutinvalidate(void);
+static unsigned int itemw(struct item *item);
+static unsigned int itemw_clamp(struct item *item, unsigned int n);
@@ -1,9 +1,60 @@
+/* set entry i of the frame's hit table, growing it as needed */
+static struct hit *
+hitadd(size_t i, int x, int y, int w, int h, int kind, struct item *item)
+{
+	if (i >= hitsize) {
+		hitsize = MAX(hitsize * 2, i + 64);
+		if (!(hits = realloc(hits, hitsize * sizeof *hits)))
+			die("cannot realloc %zu bytes:", hitsize * sizeof *hits);
+	}
+	hits[i].x = x;
+	hits[i].y = y;
+	hits[i].w = w;
+	hits[i].h = h;
+	hits[i].kind = kind;
+	hits[i].item = item;
+	nhits = MAX(nhits, i + 1);
+	return &hits[i];
+}
+
+/* last entry at or before (y, x), all entries of a row sharing their y */
+static size_t
+hitfind(int x, int y)
+{
+	size_t lo = 0, hi = nhits, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (hits[mid].y < y || (hits[mid].y == y && hits[mid].x <= x))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static const struct hit *
+hitat(int x, int y)
+{
+	size_t i;
+	const struct hit *h;
+
+	/* the row first, then the entry within it */
+	if (!(i = hitfind(INT_MAX, y)))
+		return NULL;
+	if (!(i = hitfind(x, hits[i - 1].y)))
+		return NULL;
+	h = &hits[i - 1];
+	if (x < h->x || x >= h->x + h->w || y < h->y || y >= h->y + h->h)
+		return NULL;
+	return h;
+}
+
 static void
 buttonpress(XEvent *e)
 {
-	struct item *item;
 	XButtonPressedEvent *ev = &e->xbutton;
-	int x = 0, y = 0, h = bh, w;
+	const struct hit *h;
 
 	if (ev->window != win)
 		return;
@@ -12,19 +63,9 @@ buttonpress(XEvent *e)
 	if (ev->button == Button3)
 		exit(1);
 
-	if (prompt && *prompt)
-		x += promptw;
-
-	/* input field */
-	w = (lines > 0 || !matches) ? mw - x : inputw;
-
-	/* left-click on input: clear input,
-	 * NOTE: if there is no left-arrow the space for < is reserved so
-	 *       add that to the input width */
-	if (ev->button == Button1 &&
-	   ((lines <= 0 && ev->x >= 0 && ev->x <= x + w +
-	   ((!prev || !curr->left) ? TEXTW("<") : 0)) ||
-	   (lines > 0 && ev->y >= y && ev->y <= y + h))) {
+	h = hitat(ev->x, ev->y);
+	/* left-click on input: clear input */
+	if (ev->button == Button1 && h && h->kind == HitInput) {
 		insert(NULL, -cursor);
 		drawmenu();
 		return;
@@ -50,69 +91,51 @@ buttonpress(XEvent *e)
 		drawmenu();
 		return;
 	}
-	if (ev->button != Button1)
+	if (ev->button != Button1 || !h)
 		return;
 	if (ev->state & ~ControlMask)
 		return;
-	if (lines > 0) {
-		/* vertical list: (ctrl)left-click on item */
-		w = mw - x;
-		for (item = curr; item != next; item = item->right) {
-			y += h;
-			if (ev->y >= y && ev->y <= (y + h)) {
-				if (!(ev->state & ControlMask)) {
-					sel = item;
-					selsel();
-					printsel(ev->state);
-					exit(0);
-				}
-				sel = item;
-				if (sel) {
-					selsel();
-					drawmenu();
-				}
-				return;
-			}
-		}
-	} else if (matches) {
+	switch (h->kind) {
+	case HitLeft:
 		/* left-click on left arrow */
-		x += inputw;
-		w = TEXTW("<");
-		if (prev && curr->left) {
-			if (ev->x >= x && ev->x <= x + w) {
-				sel = curr = prev;
-				calcoffsets();
-				drawmenu();
-				return;
-			}
-		}
-		/* horizontal list: (ctrl)left-click on item */
-		for (item = curr; item != next; item = item->right) {
-			x += w;
-			w = MIN(TEXTW(item->text), mw - x - TEXTW(">"));
-			if (ev->x >= x && ev->x <= x + w) {
-				if (!(ev->state & ControlMask)) {
-					sel = item;
-					selsel();
-					printsel(ev->state);
-					exit(0);
-				}
-				sel = item;
-				if (sel) {
-					selsel();
-					drawmenu();
-				}
-				return;
-			}
-		}
+		if (!prev)
+			break;
+		sel = curr = prev;
+		calcoffsets();
+		drawmenu();
+		break;
+	case HitRight:
 		/* left-click on right arrow */
-		w = TEXTW(">");
-		x = mw - w;
-		if (next && ev->x >= x && ev->x <= x + w) {
-			sel = curr = next;
-			calcoffsets();
-			drawmenu();
-			return;
+		if (!next)
+			break;
+		sel = curr = next;
+		calcoffsets();
+		drawmenu();
+		break;
+	case HitItem:
+		/* (ctrl)left-click on item, if it is still listed */
+		if (!h->item || h->item->pos >= nmatches || matchv[h->item->pos] != h->item)
+			break;
+		sel = h->item;
+		selsel();
+		if (!(ev->state & ControlMask)) {
+			printsel(ev->state);
+			exit(0);
 		}
+		drawmenu();
+		break;
 	}
 }
+
+/* highlight the item under the pointer, x and y are -1 once it left */
+static void
+motion(int x, int y)
+{
+	const struct hit *h = hover ? hitat(x, y) : NULL;
+	struct item *item = h && h->kind == HitItem ? h->item : NULL;
+
+	if (item == hovered)
+		return;
+	hovered = item;
+	pendingdraw = 1;
+}
@@ -0,0 +1,19 @@
+enum { HitInput, HitLeft, HitRight, HitItem }; /* hit kinds */
+
+/* where drawmenu() put something clickable in the last frame; the bar
+ * row comes first, then the grid in row-major order, each row from left
+ * to right */
+struct hit {
+	int x, y, w, h;
+	int kind;
+	struct item *item; /* HitItem, NULL for an empty grid slot */
+};
+
+static struct hit *hits;
+static size_t nhits, hitsize;
+static struct item *hovered; /* item under the pointer */
+
+static struct hit *hitadd(size_t i, int x, int y, int w, int h, int kind, struct item *item);
+static const struct hit *hitat(int x, int y);
+static void buttonpress(XEvent *e);
+static void motion(int x, int y);
@@ -0,0 +1,41 @@
+/* parse a -nth field range: N, N.., ..M or N..M */
+static void
+nthparse(const char *s)
+{
+	char *p;
+
+	nthfrom = strtol(s, &p, 10);
+	if (strncmp(p, "..", 2)) {
+		nthto = nthfrom;
+	} else {
+		nthto = strtol(p + 2, &p, 10);
+		nthfrom = MAX(nthfrom, 1);
+	}
+	if (*p || nthfrom < 1 || nthto < 0 || (nthto && nthto < nthfrom))
+		die("invalid field range: %s", s);
+}
+
+/* record the byte range of the item text that is matched against */
+static void
+nthspan(struct item *item)
+{
+	const char *s = item->text, *p = s, *q;
+	int field = 1;
+
+	item->mstart = 0;
+	item->mlen = strlen(s);
+	if (!nthfrom)
+		return;
+	for (; field < nthfrom && (q = strchr(p, nthdelim)); field++)
+		p = q + 1;
+	if (field < nthfrom) { /* not enough fields */
+		item->mstart = item->mlen;
+		item->mlen = 0;
+		return;
+	}
+	item->mstart = p - s;
+	if (nthto)
+		for (; field < nthto && (q = strchr(p, nthdelim)); field++)
+			p = q + 1;
+	item->mlen = (nthto && (q = strchr(p, nthdelim)) ? q - s : item->mlen) - item->mstart;
+}
@@ -0,0 +1,5 @@
+static int nthfrom = 0, nthto = 0; /* -nth field range, 1-based, 0 if open */
+static char nthdelim = '\t';       /* -nd field separator */
+
+static void nthparse(const char *s);
+static void nthspan(struct item *item);
@@ -3,14 +3,5 @@ static char numbers[NUMBERSBUFSIZE] = "";
 static void
 recalculatenumbers()
 {
-	unsigned int numer = 0, denom = 0;
-	struct item *item;
-	if (matchend) {
-		numer++;
-		for (item = matchend; item && item->left; item = item->left)
-			numer++;
-	}
-	for (item = items; item && item->text; item++)
-		denom++;
-	snprintf(numbers, NUMBERSBUFSIZE, "%d/%d", numer, denom);
+	snprintf(numbers, NUMBERSBUFSIZE, "%zu/%zu", nmatches, nitems);
 }
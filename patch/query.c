@@ -0,0 +1,261 @@
+static int
+termcost(const struct term *t)
+{
+	switch (t->type) {
+	case TermEqual:  return 0;
+	case TermPrefix: return 1;
+	case TermSuffix: return 2;
+	case TermExact:  return 3;
+	default:         return fuzzy ? 4 : 3;
+	}
+}
+
+/* parse the input once per change into AND-ed groups of OR-ed terms,
+ * cheapest groups (anchored terms, length check + compare) first */
+static void
+compilequery(void)
+{
+	static char src[sizeof text], buf[sizeof text];
+	static int cap = 0;
+	struct termgroup g;
+	struct term *t;
+	char *s;
+	size_t len;
+	int i, j, alt = 0;
+
+	if (qterms && !strcmp(src, text))
+		return;
+	strcpy(src, text);
+	strcpy(buf, text);
+	qtermn = qgroupn = 0;
+	qlead = "";
+	qleadlen = 0;
+
+	for (s = strtok(buf, " "); s; s = strtok(NULL, " ")) {
+		if (!strcmp(s, "|")) {
+			alt = qtermn > 0;
+			continue;
+		}
+		if (qtermn >= cap) {
+			cap += 8;
+			if (!(qterms = realloc(qterms, cap * sizeof *qterms))
+			|| !(qgroups = realloc(qgroups, cap * sizeof *qgroups)))
+				die("cannot realloc %zu bytes:", cap * sizeof *qterms);
+		}
+		t = &qterms[qtermn++];
+		t->type = TermFuzzy;
+		t->inv = 0;
+		t->alt = alt;
+		alt = 0;
+		if (s[0] == '!' && s[1]) {
+			t->inv = 1;
+			t->type = TermExact;
+			s++;
+		}
+		if (s[0] == '\'' && s[1]) {
+			t->type = TermExact;
+			s++;
+		} else if (s[0] == '^' && s[1]) {
+			t->type = TermPrefix;
+			s++;
+		}
+		len = strlen(s);
+		if (len > 1 && s[len - 1] == '$') {
+			s[--len] = '\0';
+			t->type = t->type == TermPrefix ? TermEqual : TermSuffix;
+		}
+		t->str = s;
+		t->len = len;
+		t->chars = charmask(s);
+		if (!t->inv && !qleadlen) {
+			qlead = s;
+			qleadlen = len;
+		}
+	}
+
+	/* group alternatives, then order the groups by cost (insertion sort,
+	 * queries are short) */
+	for (i = 0; i < qtermn; i++) {
+		if (!qterms[i].alt) {
+			qgroups[qgroupn].first = i;
+			qgroups[qgroupn].n = 0;
+			qgroups[qgroupn++].cost = 0;
+		}
+		qgroups[qgroupn - 1].n++;
+		qgroups[qgroupn - 1].cost = MAX(qgroups[qgroupn - 1].cost, termcost(&qterms[i]));
+	}
+	for (i = 1; i < qgroupn; i++) {
+		g = qgroups[i];
+		for (j = i; j > 0 && qgroups[j - 1].cost > g.cost; j--)
+			qgroups[j] = qgroups[j - 1];
+		qgroups[j] = g;
+	}
+}
+
+/* find sub in the first len bytes of s; memchr(3) skips ahead to candidate
+ * positions whenever the first byte has no case to fold */
+static const char *
+spanstr(const char *s, size_t len, const char *sub, size_t sublen)
+{
+	const char *end;
+	int lc, uc;
+
+	if (sublen > len)
+		return NULL;
+	lc = uc = (unsigned char)sub[0];
+	if (fstrncmp != strncmp) {
+		lc = tolower(lc);
+		uc = toupper(lc);
+	}
+	for (end = s + len - sublen + 1; s < end; s++) {
+		if (lc == uc) {
+			if (!(s = memchr(s, lc, end - s)))
+				return NULL;
+		} else if (tolower((unsigned char)*s) != lc) {
+			continue;
+		}
+		if (!fstrncmp(s, sub, sublen))
+			return s;
+	}
+	return NULL;
+}
+
+static int
+termmatch(const struct term *t, const char *s, size_t len, unsigned long long bounds,
+          double *dist)
+{
+	int r;
+
+	switch (t->type) {
+	case TermEqual:
+		r = len == t->len && !fstrncmp(s, t->str, len);
+		break;
+	case TermPrefix:
+		r = len >= t->len && !fstrncmp(s, t->str, t->len);
+		break;
+	case TermSuffix:
+		r = len >= t->len && !fstrncmp(s + len - t->len, t->str, t->len);
+		break;
+	case TermFuzzy:
+		if (fuzzy) {
+			r = fuzzyscore(s, len, bounds, t->str, t->len, dist, NULL);
+			break;
+		}
+		/* fallthrough */
+	default:
+		r = spanstr(s, len, t->str, t->len) != NULL;
+		break;
+	}
+	return r != t->inv;
+}
+
+/* run the compiled query against item, adding the fuzzy distance of every
+ * matching positive term to *dist */
+static int
+querymatch(struct item *item, double *dist)
+{
+	const struct termgroup *g;
+	const char *s = item->text + item->mstart;
+	size_t len = item->mlen;
+	double d, total = 0;
+	int i, j;
+
+	for (i = 0; i < qgroupn; i++) {
+		g = &qgroups[i];
+		for (j = 0; j < g->n; j++) {
+			d = 0;
+			if (termmatch(&qterms[g->first + j], s, len, item->bounds, &d)) {
+				total += d;
+				break;
+			}
+		}
+		if (j == g->n)
+			return 0;
+	}
+	if (dist)
+		*dist = total;
+	return 1;
+}
+
+/* append the byte ranges of s that a positive term t matches to sp */
+static int
+termspans(const struct term *t, const char *s, size_t len, unsigned long long bounds,
+          struct span *sp, int max)
+{
+	static int pos[sizeof text];
+	const char *p;
+	double d;
+	int i, first, last, n = 0;
+
+	switch (t->type) {
+	case TermEqual:
+	case TermPrefix:
+		if (!termmatch(t, s, len, bounds, &d))
+			return 0;
+		p = s;
+		break;
+	case TermSuffix:
+		if (!termmatch(t, s, len, bounds, &d))
+			return 0;
+		p = s + len - t->len;
+		break;
+	case TermFuzzy:
+		if (!fuzzy && (p = spanstr(s, len, t->str, t->len)))
+			break;
+		/* matched byte by byte, or by the acronym tier */
+		if (fuzzy ? !fuzzyscore(s, len, bounds, t->str, t->len, &d, pos)
+		    : acronym(s, len, bounds, t->str, t->len, &first, &last, pos) < 2)
+			return 0;
+		for (i = 0; i < (int)t->len && n < max; i++) {
+			if (n && sp[n - 1].end == (unsigned int)pos[i])
+				sp[n - 1].end++;
+			else
+				sp[n].start = pos[i], sp[n++].end = pos[i] + 1;
+		}
+		return n;
+	default:
+		if (!(p = spanstr(s, len, t->str, t->len)))
+			return 0;
+		break;
+	}
+	if (!max)
+		return 0;
+	sp[0].start = p - s;
+	sp[0].end = p - s + t->len;
+	return 1;
+}
+
+/* byte ranges of the -nth span of item that the positive terms of the query
+ * match, sorted and merged; used to highlight what the matcher found */
+static int
+queryspans(struct item *item, struct span *sp, int max)
+{
+	const struct term *t;
+	const char *s = item->text + item->mstart;
+	struct span tmp;
+	int i, j, hit = 0, n = 0;
+
+	compilequery();
+	for (i = 0; i < qtermn && n < max; i++) {
+		t = &qterms[i];
+		if (!t->alt)
+			hit = 0;
+		/* only the first alternative that matches is highlighted */
+		if (t->inv || hit)
+			continue;
+		n += (hit = termspans(t, s, item->mlen, item->bounds, sp + n, max - n));
+	}
+	for (i = 1; i < n; i++) {
+		tmp = sp[i];
+		for (j = i; j > 0 && sp[j - 1].start > tmp.start; j--)
+			sp[j] = sp[j - 1];
+		sp[j] = tmp;
+	}
+	for (i = 0, j = 1; j < n; j++) {
+		if (sp[j].start <= sp[i].end)
+			sp[i].end = MAX(sp[i].end, sp[j].end);
+		else
+			sp[++i] = sp[j];
+	}
+	return n ? i + 1 : 0;
+}
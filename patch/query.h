@@ -0,0 +1,29 @@
+enum { TermFuzzy, TermExact, TermPrefix, TermSuffix, TermEqual }; /* term types */
+
+struct term {
+	const char *str;
+	size_t len;
+	int type;
+	int inv; /* !term: item must not match */
+	int alt; /* term | prev: either of them may match */
+	unsigned int chars; /* character classes, see charmask() */
+};
+
+struct span {
+	unsigned int start, end; /* byte range [start, end) */
+};
+
+struct termgroup {
+	int first, n; /* alternatives, qterms[first .. first + n) */
+	int cost;
+};
+
+static struct term *qterms;
+static struct termgroup *qgroups;
+static int qtermn, qgroupn;
+static const char *qlead = ""; /* first positive term, used for prefix ranking */
+static size_t qleadlen;
+
+static void compilequery(void);
+static int querymatch(struct item *item, double *dist);
+static int queryspans(struct item *item, struct span *sp, int max);
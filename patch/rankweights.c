@@ -0,0 +1,42 @@
+/* strip a leading "weight<tab>" or "weight<space>" field from line, in place
+ * so the line can still be freed, and return the weight */
+static int
+readweight(char *line)
+{
+	char *p;
+	long w;
+
+	w = strtol(line, &p, 10);
+	if (p == line || (*p != '\t' && *p != ' '))
+		return 0;
+	memmove(line, p + 1, strlen(p + 1) + 1);
+	return (int)MAX(MIN(w, INT_MAX / 2), INT_MIN / 2);
+}
+
+static int
+compare_weight(const void *a, const void *b)
+{
+	const struct item *da = *(struct item **)a;
+	const struct item *db = *(struct item **)b;
+
+	if (da->weight != db->weight)
+		return da->weight > db->weight ? -1 : 1;
+	return da->id - db->id;
+}
+
+/* the items by descending weight, ties in input order, NULL terminated;
+ * match() walks them in this order so that every tier comes out sorted */
+static void
+weightorder(void)
+{
+	size_t i;
+
+	free(byweight);
+	byweight = NULL;
+	if (!weighted || !items)
+		return;
+	byweight = ecalloc(nitems + 1, sizeof *byweight);
+	for (i = 0; i < nitems; i++)
+		byweight[i] = &items[i];
+	qsort(byweight, nitems, sizeof *byweight, compare_weight);
+}
@@ -0,0 +1,6 @@
+static int weighted = 0;
+
+static int readweight(char *line);
+static struct item **byweight; /* see weightorder() */
+
+static void weightorder(void);
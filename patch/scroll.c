@@ -9,22 +9,54 @@ utf8nextchar(const char *str, int len, int i, int inc)
 	return n;
 }
 
+/* longest prefix (AlignL) or suffix (AlignR) of text that fits in w,
+ * found by bisecting its advances; returns its length, *start is where
+ * it begins */
+static size_t
+textfit(Drw *drw, const char *text, size_t len, unsigned int w, int align, size_t *start)
+{
+	unsigned int *adv = ecalloc(len + 1, sizeof *adv);
+	size_t lo, hi, mid;
+
+	drw_text_advances(drw, text, len, adv);
+	if (align == AlignL) {
+		for (lo = 0, hi = len; lo < hi; ) {
+			mid = (lo + hi + 1) / 2;
+			if (adv[mid] <= w)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+		/* bytes inside a character share its start position */
+		while (lo > 0 && lo < len && (text[lo] & 0xc0) == 0x80)
+			lo--;
+		*start = 0;
+	} else {
+		for (lo = 0, hi = len; lo < hi; ) {
+			mid = (lo + hi) / 2;
+			if (adv[len] - adv[mid] > w)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		while (lo < len && (text[lo] & 0xc0) == 0x80)
+			lo++;
+		*start = lo;
+		lo = len - lo;
+	}
+	free(adv);
+	return lo;
+}
+
 int
 drw_text_align(Drw *drw, int x, int y, unsigned int w, unsigned int h, const char *text, int textlen, int align)
 {
-	int ty;
 	unsigned int ew;
-	XftDraw *d = NULL;
 	Fnt *usedfont, *curfont, *nextfont;
-	size_t len;
+	size_t len, start;
 	int utf8strlen, utf8charlen, render = x || y || w || h;
 	long utf8codepoint = 0;
 	const char *utf8str;
-	FcCharSet *fccharset;
-	FcPattern *fcpattern;
-	FcPattern *match;
-	XftResult result;
-	int charexists = 0;
 	int i, n;
 
 	if (!drw || (render && !drw->scheme) || !text || !drw->fonts || textlen <= 0
@@ -34,11 +66,7 @@ drw_text_align(Drw *drw, int x, int y, unsigned int w, unsigned int h, const cha
 	if (!render) {
 		w = ~w;
 	} else {
-		XSetForeground(drw->dpy, drw->gc, drw->scheme[ColBg].pixel);
-		XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
-		d = XftDrawCreate(drw->dpy, drw->drawable,
-		                  DefaultVisual(drw->dpy, drw->screen),
-		                  DefaultColormap(drw->dpy, drw->screen));
+		drw_queue_rect(drw, x, y, w, h, drw->scheme[ColBg].pixel);
 	}
 
 	usedfont = drw->fonts;
@@ -67,23 +95,13 @@ drw_text_align(Drw *drw, int x, int y, unsigned int w, unsigned int h, const cha
 					break;
 				}
 			}
-			for (curfont = drw->fonts; curfont; curfont = curfont->next) {
-				charexists = charexists || XftCharExists(drw->dpy, curfont->xfont, utf8codepoint);
-				if (charexists) {
-					if (curfont == usedfont) {
-						utf8strlen += utf8charlen;
-						i += align == AlignL ? utf8charlen : -utf8charlen;
-					} else {
-						nextfont = curfont;
-					}
-					break;
-				}
-			}
-
-			if (!charexists || nextfont)
+			curfont = drw_glyph(drw, utf8codepoint)->font;
+			if (curfont != usedfont) {
+				nextfont = curfont;
 				break;
-			else
-				charexists = 0;
+			}
+			utf8strlen += utf8charlen;
+			i += align == AlignL ? utf8charlen : -utf8charlen;
 		}
 
 		if (align == AlignR)
@@ -91,27 +109,18 @@ drw_text_align(Drw *drw, int x, int y, unsigned int w, unsigned int h, const cha
 
 		if (utf8strlen) {
 			drw_font_getexts(usedfont, utf8str, utf8strlen, &ew, NULL);
+			len = utf8strlen;
 			/* shorten text if necessary */
-			if (align == AlignL) {
-				for (len = utf8strlen; len && ew > w; ) {
-					len = utf8nextchar(utf8str, len, len, -1);
-					drw_font_getexts(usedfont, utf8str, len, &ew, NULL);
-				}
-			} else {
-				for (len = utf8strlen; len && ew > w; ) {
-					n = utf8nextchar(utf8str, len, 0, +1);
-					utf8str += n;
-					len -= n;
-					drw_font_getexts(usedfont, utf8str, len, &ew, NULL);
-				}
+			if (ew > w) {
+				len = textfit(drw, utf8str, utf8strlen, w, align, &start);
+				utf8str += start;
+				drw_font_getexts(usedfont, utf8str, len, &ew, NULL);
 			}
 
 			if (len) {
-				if (render) {
-					ty = y + (h - usedfont->h) / 2 + usedfont->xfont->ascent;
-					XftDrawStringUtf8(d, &drw->scheme[ColFg],
-					                  usedfont->xfont, align == AlignL ? x : x - ew, ty, (XftChar8 *)utf8str, len);
-				}
+				if (render)
+					drw_queue_text(drw, usedfont, &drw->scheme[ColFg],
+					               align == AlignL ? x : x - ew, y, h, utf8str, len);
 				x += align == AlignL ? ew : -ew;
 				w -= ew;
 			}
@@ -119,50 +128,10 @@ drw_text_align(Drw *drw, int x, int y, unsigned int w, unsigned int h, const cha
 				break;
 		}
 
-		if ((align == AlignR && i <= 0) || (align == AlignL && i >= textlen)) {
+		if ((align == AlignR && i <= 0) || (align == AlignL && i >= textlen))
 			break;
-		} else if (nextfont) {
-			charexists = 0;
-			usedfont = nextfont;
-		} else {
-			/* Regardless of whether or not a fallback font is found, the
-			 * character must be drawn. */
-			charexists = 1;
-
-			fccharset = FcCharSetCreate();
-			FcCharSetAddChar(fccharset, utf8codepoint);
-
-			if (!drw->fonts->pattern) {
-				/* Refer to the comment in xfont_create for more information. */
-				die("the first font in the cache must be loaded from a font string.");
-			}
-
-			fcpattern = FcPatternDuplicate(drw->fonts->pattern);
-			FcPatternAddCharSet(fcpattern, FC_CHARSET, fccharset);
-			FcPatternAddBool(fcpattern, FC_SCALABLE, FcTrue);
-
-			FcConfigSubstitute(NULL, fcpattern, FcMatchPattern);
-			FcDefaultSubstitute(fcpattern);
-			match = XftFontMatch(drw->dpy, drw->screen, fcpattern, &result);
-
-			FcCharSetDestroy(fccharset);
-			FcPatternDestroy(fcpattern);
-
-			if (match) {
-				usedfont = xfont_create(drw, NULL, match);
-				if (usedfont && XftCharExists(drw->dpy, usedfont->xfont, utf8codepoint)) {
-					for (curfont = drw->fonts; curfont->next; curfont = curfont->next)
-						; /* NOP */
-					curfont->next = usedfont;
-				} else {
-					xfont_free(usedfont);
-					usedfont = drw->fonts;
-				}
-			}
-		}
+		usedfont = nextfont;
 	}
-	if (d)
-		XftDrawDestroy(d);
 
 	return x;
 }
@@ -0,0 +1,369 @@
+static int shmfailed;
+
+static int
+nativeorder(void)
+{
+	const uint32_t one = 1;
+
+	return *(const unsigned char *)&one ? LSBFirst : MSBFirst;
+}
+
+static int
+shmerror(Display *dpy, XErrorEvent *ee)
+{
+	/* typically BadAccess from XShmAttach on a remote display */
+	shmfailed = 1;
+	return 0;
+}
+
+static void
+shm_image_free(Drw *drw)
+{
+	Shm *shm = drw->shm;
+
+	if (!shm->img)
+		return;
+	XShmDetach(drw->dpy, &shm->info);
+	shm->img->data = NULL; /* shared memory, not ours to free() */
+	XDestroyImage(shm->img);
+	shmdt(shm->info.shmaddr);
+	shm->img = NULL;
+}
+
+/* (re)create the image for the current size, 0 if SHM can not be used */
+static int
+shm_image(Drw *drw)
+{
+	Shm *shm = drw->shm;
+	XImage *img;
+	int (*xerrorxlib)(Display *, XErrorEvent *);
+
+	shm_image_free(drw);
+	img = XShmCreateImage(drw->dpy, drw->visual, drw->depth, ZPixmap, NULL,
+	                      &shm->info, drw->w, drw->h);
+	if (!img)
+		return 0;
+	if (img->bits_per_pixel != 32 || img->byte_order != nativeorder()
+	|| (img->red_mask | img->green_mask | img->blue_mask) != 0xffffff
+	|| (shm->info.shmid = shmget(IPC_PRIVATE, img->bytes_per_line * img->height,
+	                             IPC_CREAT | 0600)) == -1) {
+		XDestroyImage(img);
+		return 0;
+	}
+	shm->info.shmaddr = img->data = shmat(shm->info.shmid, NULL, 0);
+	shm->info.readOnly = False;
+	if (shm->info.shmaddr == (char *)-1) {
+		shmctl(shm->info.shmid, IPC_RMID, NULL);
+		img->data = NULL;
+		XDestroyImage(img);
+		return 0;
+	}
+	/* the attach is only known to work after a round-trip */
+	shmfailed = 0;
+	xerrorxlib = XSetErrorHandler(shmerror);
+	XShmAttach(drw->dpy, &shm->info);
+	XSync(drw->dpy, False);
+	XSetErrorHandler(xerrorxlib);
+	/* the segment goes away with the last detach */
+	shmctl(shm->info.shmid, IPC_RMID, NULL);
+	if (shmfailed) {
+		shmdt(shm->info.shmaddr);
+		img->data = NULL;
+		XDestroyImage(img);
+		return 0;
+	}
+	shm->img = img;
+	return 1;
+}
+
+static void
+shm_create(Drw *drw)
+{
+	if (!XShmQueryExtension(drw->dpy))
+		return;
+	drw->shm = ecalloc(1, sizeof(Shm));
+	drw->shm->completion = XShmGetEventBase(drw->dpy) + ShmCompletion;
+	if (!shm_image(drw)) {
+		free(drw->shm);
+		drw->shm = NULL;
+	}
+}
+
+static void
+shm_glyphs_clear(Drw *drw)
+{
+	int i;
+
+	for (i = 0; i < SHM_GLYPHS; i++) {
+		free(drw->shm->glyphs[i].a);
+		drw->shm->glyphs[i].a = NULL;
+		drw->shm->glyphs[i].font = NULL;
+	}
+}
+
+static void
+shm_free(Drw *drw)
+{
+	shm_image_free(drw);
+	shm_glyphs_clear(drw);
+	free(drw->shm);
+	drw->shm = NULL;
+}
+
+static void
+shm_resize(Drw *drw)
+{
+	if (!shm_image(drw))
+		shm_free(drw); /* back to the Xft path */
+}
+
+static void
+shm_fill(Drw *drw, const XRectangle *r, unsigned long pixel)
+{
+	XImage *img = drw->shm->img;
+	int x, y, x0 = MAX(r->x, 0), y0 = MAX(r->y, 0);
+	int x1 = MIN(r->x + r->width, img->width), y1 = MIN(r->y + r->height, img->height);
+	uint32_t *p;
+
+	for (y = y0; y < y1; y++) {
+		p = (uint32_t *)(img->data + y * img->bytes_per_line);
+		for (x = x0; x < x1; x++)
+			p[x] = pixel;
+	}
+}
+
+/* FreeType load flags for the rendering Xft would use for font, see
+ * XftFontInfoFill(); sets *bgr for a subpixel order with blue first */
+static FT_Int32
+shm_loadflags(XftFont *font, FT_Face face, int *bgr)
+{
+	FcBool antialias = FcTrue, hinting = FcTrue, autohint = FcFalse, bitmaps = FcTrue;
+	int hintstyle = FC_HINT_FULL, rgba = FC_RGBA_UNKNOWN, filter = FC_LCD_DEFAULT;
+	FT_Int32 flags = FT_LOAD_COLOR;
+
+	FcPatternGetBool(font->pattern, FC_ANTIALIAS, 0, &antialias);
+	FcPatternGetBool(font->pattern, FC_HINTING, 0, &hinting);
+	FcPatternGetBool(font->pattern, FC_AUTOHINT, 0, &autohint);
+	FcPatternGetBool(font->pattern, FC_EMBEDDED_BITMAP, 0, &bitmaps);
+	FcPatternGetInteger(font->pattern, FC_HINT_STYLE, 0, &hintstyle);
+	FcPatternGetInteger(font->pattern, FC_RGBA, 0, &rgba);
+	FcPatternGetInteger(font->pattern, FC_LCD_FILTER, 0, &filter);
+
+	*bgr = 0;
+	if (!antialias) {
+		flags |= FT_LOAD_TARGET_MONO;
+	} else if (rgba == FC_RGBA_RGB || rgba == FC_RGBA_BGR) {
+		/* vertical subpixel orders are drawn in grayscale */
+		flags |= FT_LOAD_TARGET_LCD;
+		*bgr = rgba == FC_RGBA_BGR;
+		FT_Library_SetLcdFilter(face->glyph->library,
+			filter == FC_LCD_NONE ? FT_LCD_FILTER_NONE :
+			filter == FC_LCD_LIGHT ? FT_LCD_FILTER_LIGHT :
+			filter == FC_LCD_LEGACY ? FT_LCD_FILTER_LEGACY : FT_LCD_FILTER_DEFAULT);
+	} else if (hintstyle == FC_HINT_SLIGHT) {
+		flags |= FT_LOAD_TARGET_LIGHT;
+	} else {
+		flags |= FT_LOAD_TARGET_NORMAL;
+	}
+	if (!hinting || hintstyle == FC_HINT_NONE)
+		flags |= FT_LOAD_NO_HINTING;
+	if (autohint)
+		flags |= FT_LOAD_FORCE_AUTOHINT;
+	if (!bitmaps)
+		flags |= FT_LOAD_NO_BITMAP;
+	return flags;
+}
+
+/* premultiplied BGRA, box filtered down when a bitmap strike is larger
+ * than the requested pixel size, as for most colour emoji fonts */
+static void
+shm_glyph_color(ShmGlyph *g, XftFont *font, FT_Face face)
+{
+	FT_Bitmap *bm = &face->glyph->bitmap;
+	double size, scale = 1;
+	unsigned int x, y, sx, sy, sx0, sx1, sy0, sy1, n, c, sum[4];
+	const unsigned char *q;
+	uint32_t *px;
+
+	if (!FT_IS_SCALABLE(face) && face->size->metrics.y_ppem
+	&& FcPatternGetDouble(font->pattern, FC_PIXEL_SIZE, 0, &size) == FcResultMatch
+	&& size < face->size->metrics.y_ppem)
+		scale = size / face->size->metrics.y_ppem;
+	g->w = MAX(bm->width * scale + 0.5, 1);
+	g->h = MAX(bm->rows * scale + 0.5, 1);
+	g->left = face->glyph->bitmap_left * scale;
+	g->top = face->glyph->bitmap_top * scale + 0.5;
+	g->a = ecalloc(g->w * g->h, sizeof *px);
+	px = (uint32_t *)g->a;
+	for (y = 0; y < g->h; y++) {
+		sy0 = y / scale;
+		sy1 = MIN(MAX((unsigned int)((y + 1) / scale), sy0 + 1), bm->rows);
+		for (x = 0; x < g->w; x++) {
+			sx0 = x / scale;
+			sx1 = MIN(MAX((unsigned int)((x + 1) / scale), sx0 + 1), bm->width);
+			sum[0] = sum[1] = sum[2] = sum[3] = n = 0;
+			for (sy = sy0; sy < sy1; sy++)
+				for (sx = sx0; sx < sx1; sx++, n++)
+					for (q = bm->buffer + sy * bm->pitch + sx * 4, c = 0; c < 4; c++)
+						sum[c] += q[c];
+			if (n)
+				px[y * g->w + x] = (uint32_t)(sum[3] / n) << 24 | (sum[2] / n) << 16
+				                 | (sum[1] / n) << 8 | sum[0] / n;
+		}
+	}
+}
+
+/* render a glyph into a coverage bitmap or, for colour glyphs, a pixel
+ * bitmap, cached per font */
+static const ShmGlyph *
+shm_glyph(Drw *drw, XftFont *font, FT_UInt glyph)
+{
+	ShmGlyph *g = &drw->shm->glyphs[((uintptr_t)font / sizeof(void *) * 31 + glyph) % SHM_GLYPHS];
+	FT_Int32 flags;
+	FT_Face face;
+	FT_Bitmap *bm;
+	unsigned int x, y;
+	int bgr;
+	const unsigned char *q;
+
+	if (g->font == font && g->glyph == glyph)
+		return g;
+	free(g->a);
+	g->a = NULL;
+	g->font = font;
+	g->glyph = glyph;
+	g->w = g->h = 0;
+	if (!(face = XftLockFace(font)))
+		return g;
+	flags = shm_loadflags(font, face, &bgr);
+	if (!FT_Load_Glyph(face, glyph, flags | FT_LOAD_RENDER)
+	&& (bm = &face->glyph->bitmap)->width && bm->rows) {
+		g->left = face->glyph->bitmap_left;
+		g->top = face->glyph->bitmap_top;
+		switch (bm->pixel_mode) {
+		case FT_PIXEL_MODE_GRAY:
+		case FT_PIXEL_MODE_MONO:
+			g->kind = ShmGray;
+			g->w = bm->width;
+			g->h = bm->rows;
+			g->a = ecalloc(g->w * g->h, 1);
+			for (y = 0; y < g->h; y++)
+				for (x = 0; x < g->w; x++)
+					g->a[y * g->w + x] = bm->pixel_mode == FT_PIXEL_MODE_GRAY
+						? bm->buffer[y * bm->pitch + x]
+						: (bm->buffer[y * bm->pitch + x / 8] & (0x80 >> x % 8)) ? 255 : 0;
+			break;
+		case FT_PIXEL_MODE_LCD:
+			/* three coverage values per pixel, stored red first */
+			g->kind = ShmLcd;
+			g->w = bm->width / 3;
+			g->h = bm->rows;
+			g->a = ecalloc(g->w * g->h, 3);
+			for (y = 0; y < g->h; y++)
+				for (x = 0; x < g->w; x++) {
+					q = bm->buffer + y * bm->pitch + x * 3;
+					g->a[(y * g->w + x) * 3 + 0] = q[bgr ? 2 : 0];
+					g->a[(y * g->w + x) * 3 + 1] = q[1];
+					g->a[(y * g->w + x) * 3 + 2] = q[bgr ? 0 : 2];
+				}
+			break;
+		case FT_PIXEL_MODE_BGRA:
+			g->kind = ShmColor;
+			shm_glyph_color(g, font, face);
+			break;
+		}
+	}
+	XftUnlockFace(font);
+	return g;
+}
+
+/* blend src over dst with coverage a, two channels per multiply: red and
+ * blue share one word, alpha and green the other */
+static inline uint32_t
+blend(uint32_t dst, uint32_t src, unsigned int a)
+{
+	unsigned int ia;
+
+	a += a >> 7; /* 0..256 */
+	ia = 256 - a;
+	return ((((src & 0xff00ff) * a + (dst & 0xff00ff) * ia) >> 8) & 0xff00ff)
+	     | ((((src >> 8) & 0xff00ff) * a + ((dst >> 8) & 0xff00ff) * ia) & 0xff00ff00);
+}
+
+/* blend src over dst with a coverage per colour channel */
+static inline uint32_t
+blendlcd(uint32_t dst, uint32_t src, const unsigned char *a)
+{
+	uint32_t out = 0;
+	unsigned int i, c, s, d;
+
+	for (i = 0; i < 3; i++) {
+		c = a[i] + (a[i] >> 7);
+		s = src >> (16 - 8 * i) & 0xff;
+		d = dst >> (16 - 8 * i) & 0xff;
+		out |= ((s * c + d * (256 - c)) >> 8) << (16 - 8 * i);
+	}
+	return out | (dst & 0xff000000);
+}
+
+/* premultiplied src over dst */
+static inline uint32_t
+over(uint32_t dst, uint32_t src)
+{
+	unsigned int ia = 256 - ((src >> 24) + (src >> 31));
+
+	return src + (((((dst & 0xff00ff) * ia) >> 8) & 0xff00ff)
+	     | ((((dst >> 8) & 0xff00ff) * ia) & 0xff00ff00));
+}
+
+static void
+shm_glyphs(Drw *drw, const XftGlyphFontSpec *specs, unsigned int n, unsigned long pixel)
+{
+	XImage *img = drw->shm->img;
+	const ShmGlyph *g;
+	unsigned int i;
+	int x, y, x0, y0, x1, y1, gx, gy;
+	const unsigned char *a;
+	const uint32_t *c;
+	uint32_t *p;
+
+	for (i = 0; i < n; i++) {
+		/* dropped while queueing, see drw_queue_rect() */
+		if (!specs[i].font)
+			continue;
+		if (!(g = shm_glyph(drw, specs[i].font, specs[i].glyph))->a)
+			continue;
+		gx = specs[i].x + g->left;
+		gy = specs[i].y - g->top;
+		x0 = MAX(gx, 0);
+		y0 = MAX(gy, 0);
+		x1 = MIN(gx + (int)g->w, img->width);
+		y1 = MIN(gy + (int)g->h, img->height);
+		for (y = y0; y < y1; y++) {
+			p = (uint32_t *)(img->data + y * img->bytes_per_line);
+			switch (g->kind) {
+			case ShmGray:
+				a = g->a + (y - gy) * g->w;
+				for (x = x0; x < x1; x++) {
+					if (a[x - gx] == 255)
+						p[x] = pixel;
+					else if (a[x - gx])
+						p[x] = blend(p[x], pixel, a[x - gx]);
+				}
+				break;
+			case ShmLcd:
+				a = g->a + (y - gy) * g->w * 3;
+				for (x = x0; x < x1; x++)
+					p[x] = blendlcd(p[x], pixel, &a[(x - gx) * 3]);
+				break;
+			case ShmColor:
+				/* drawn in its own colours, like Xft does */
+				c = (const uint32_t *)g->a + (y - gy) * g->w;
+				for (x = x0; x < x1; x++)
+					if (c[x - gx])
+						p[x] = over(p[x], c[x - gx]);
+				break;
+			}
+		}
+	}
+}
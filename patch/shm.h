@@ -0,0 +1,32 @@
+/* Client side rendering into a MIT-SHM XImage: drw_flush() rasterizes the
+ * queued frame with shm_fill() and shm_glyphs(), drw_map() presents it with
+ * XShmPutImage. Only 32 bit TrueColor images with 8 bit channels are
+ * handled; anything else keeps the Xft path. */
+
+#define SHM_GLYPHS 1024 /* rendered glyph cache, direct mapped */
+
+enum { ShmGray, ShmLcd, ShmColor }; /* ShmGlyph kinds */
+
+typedef struct {
+	XftFont *font;     /* NULL if the slot is unused */
+	FT_UInt glyph;
+	int kind;
+	int left, top;     /* bitmap origin relative to the pen position */
+	unsigned int w, h;
+	unsigned char *a;  /* w * h coverage values, three per pixel for
+	                    * ShmLcd, premultiplied pixels for ShmColor */
+} ShmGlyph;
+
+struct Shm {
+	XImage *img;
+	XShmSegmentInfo info;
+	int completion; /* ShmCompletion event type */
+	ShmGlyph glyphs[SHM_GLYPHS];
+};
+
+static void shm_create(Drw *drw);
+static void shm_free(Drw *drw);
+static void shm_resize(Drw *drw);
+static void shm_glyphs_clear(Drw *drw);
+static void shm_fill(Drw *drw, const XRectangle *r, unsigned long pixel);
+static void shm_glyphs(Drw *drw, const XftGlyphFontSpec *specs, unsigned int n, unsigned long pixel);
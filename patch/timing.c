@@ -0,0 +1,15 @@
+#ifdef TIMING
+/* milliseconds since the first mark, on stderr */
+static void
+timing(const char *what)
+{
+	static struct timespec start;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!start.tv_sec && !start.tv_nsec)
+		start = now;
+	fprintf(stderr, "dmenu: %-12s %8.3f ms\n", what,
+	        (now.tv_sec - start.tv_sec) * 1e3 + (now.tv_nsec - start.tv_nsec) / 1e6);
+}
+#endif
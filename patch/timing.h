@@ -0,0 +1,5 @@
+#ifdef TIMING
+static void timing(const char *what);
+#else
+#define timing(what)
+#endif
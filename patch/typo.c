@@ -0,0 +1,184 @@
+/* typo tolerant matching: Myers' bit-parallel approximate string matching,
+ * one machine word per item byte for input terms of up to 64 bytes */
+typedef unsigned long long typoword;
+
+#define TYPOMAXLEN (sizeof(typoword) * 8)
+
+struct typoterm {
+	typoword peq[256]; /* positions of each byte in the term */
+	typoword last;     /* bit of the last term byte */
+	unsigned int chars;
+	size_t len;
+	int k;             /* errors allowed */
+};
+
+static struct typoterm *typoterms;
+static int typotermn;
+static struct item **typov;
+static size_t typon, typocap;
+
+static unsigned int
+charmask(const char *s)
+{
+	unsigned int m = 0;
+	int c;
+
+	for (; *s; s++) {
+		c = tolower((unsigned char)*s);
+		if (c >= 'a' && c <= 'z')
+			m |= 1U << (c - 'a');
+		else if (c >= '0' && c <= '9')
+			m |= 1U << 26;
+		else
+			m |= 1U << (27 + c % 5);
+	}
+	return m;
+}
+
+static int
+popcount(unsigned int x)
+{
+	int n;
+
+	for (n = 0; x; x &= x - 1)
+		n++;
+	return n;
+}
+
+/* set up the typo tier for the compiled query; only plain positive terms
+ * are looked up with typos */
+static void
+typoreset(void)
+{
+	static int cap = 0;
+	struct typoterm *tt;
+	const struct term *t;
+	size_t j;
+	int i, c, any = 0;
+
+	typon = 0;
+	typotermn = 0;
+	if (!typos)
+		return;
+	for (i = 0; i < qtermn; i++) {
+		t = &qterms[i];
+		if (t->type != TermFuzzy || t->inv || t->alt
+		|| (i + 1 < qtermn && qterms[i + 1].alt) || t->len > TYPOMAXLEN)
+			return;
+	}
+	if (qtermn > cap) {
+		cap = qtermn;
+		if (!(typoterms = realloc(typoterms, cap * sizeof *typoterms)))
+			die("cannot realloc %zu bytes:", cap * sizeof *typoterms);
+	}
+	for (i = 0; i < qtermn; i++) {
+		t = &qterms[i];
+		tt = &typoterms[i];
+		memset(tt->peq, 0, sizeof tt->peq);
+		for (j = 0; j < t->len; j++) {
+			c = (unsigned char)t->str[j];
+			if (fstrncmp == strncmp) {
+				tt->peq[c] |= (typoword)1 << j;
+			} else {
+				tt->peq[tolower(c)] |= (typoword)1 << j;
+				tt->peq[toupper(c)] |= (typoword)1 << j;
+			}
+		}
+		tt->last = (typoword)1 << (t->len - 1);
+		tt->chars = t->chars;
+		tt->len = t->len;
+		tt->k = t->len / typo_ratio;
+		any |= tt->k;
+	}
+	if (any)
+		typotermn = qtermn;
+}
+
+/* remember an item that failed the exact tiers if it may be within reach */
+static void
+typocandidate(struct item *item)
+{
+	const struct typoterm *tt;
+	size_t len;
+	int i;
+
+	if (!typotermn)
+		return;
+	len = item->mlen;
+	for (i = 0; i < typotermn; i++) {
+		tt = &typoterms[i];
+		/* every character class missing from the item costs an edit */
+		if (len + tt->k < tt->len
+		|| popcount(tt->chars & ~item->chars) > tt->k)
+			return;
+	}
+	if (typon >= typocap) {
+		typocap += 64;
+		if (!(typov = realloc(typov, typocap * sizeof *typov)))
+			die("cannot realloc %zu bytes:", typocap * sizeof *typov);
+	}
+	typov[typon++] = item;
+}
+
+/* fewest edits needed to turn the term into a substring of s */
+static int
+typoerrors(const struct typoterm *tt, const char *s, size_t len)
+{
+	typoword pv = ~(typoword)0, mv = 0, eq, xv, xh, ph, mh;
+	int score = tt->len, best = tt->len;
+	size_t i;
+
+	for (i = 0; i < len && best; i++) {
+		eq = tt->peq[(unsigned char)s[i]];
+		xv = eq | mv;
+		xh = (((eq & pv) + pv) ^ pv) | eq;
+		ph = mv | ~(xh | pv);
+		mh = pv & xh;
+		if (ph & tt->last)
+			score++;
+		else if (mh & tt->last)
+			score--;
+		ph <<= 1;
+		mh <<= 1;
+		pv = mh | ~(xv | ph);
+		mv = ph & xv;
+		best = MIN(best, score);
+	}
+	return best;
+}
+
+static int
+compare_typos(const void *a, const void *b)
+{
+	const struct item *da = *(struct item **)a;
+	const struct item *db = *(struct item **)b;
+
+	if (da->distance != db->distance)
+		return da->distance < db->distance ? -1 : 1;
+	return da->id - db->id;
+}
+
+/* append the candidates within reach to the list, fewest typos first */
+static void
+typotier(struct item **list, struct item **last)
+{
+	struct item *item;
+	size_t i, n;
+	int j, e, errs;
+
+	for (i = n = 0; i < typon; i++) {
+		item = typov[i];
+		for (j = errs = 0; j < typotermn; j++) {
+			if ((e = typoerrors(&typoterms[j], item->text + item->mstart, item->mlen)) > typoterms[j].k)
+				break;
+			errs += e;
+		}
+		if (j == typotermn) {
+			item->distance = errs - item->weight;
+			typov[n++] = item;
+		}
+	}
+	qsort(typov, n, sizeof *typov, compare_typos);
+	for (i = 0; i < n; i++)
+		appenditem(typov[i], list, last);
+}
@@ -0,0 +1,4 @@
+static unsigned int charmask(const char *s);
+static void typoreset(void);
+static void typocandidate(struct item *item);
+static void typotier(struct item **list, struct item **last);
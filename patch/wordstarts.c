@@ -0,0 +1,81 @@
+#define ISWORDSTART(b, i)     ((i) < 64 && ((b) >> (i) & 1))
+
+static int
+isdelim(int c)
+{
+	return c == ' ' || c == '\t' || c == '-' || c == '_' || c == '/' || c == '.';
+}
+
+/* bitmap of the word starts among the first 64 of len bytes of s: after a
+ * delimiter and at camelCase transitions */
+static unsigned long long
+wordstarts(const char *s, size_t len)
+{
+	unsigned long long b = 0;
+	size_t i;
+	int c, prev = ' ';
+
+	for (i = 0; i < 64 && i < len; prev = c, i++) {
+		c = (unsigned char)s[i];
+		if ((isdelim(prev) && !isdelim(c))
+		|| (islower(prev) && isupper(c)))
+			b |= 1ULL << i;
+	}
+	return b;
+}
+
+/* match pat so that every word it touches is entered at its start, such as
+ * "vsc" in "Visual Studio Code" or "gco" in "git-checkout"; returns the
+ * number of word starts hit, 0 if there is no such match. The offset each
+ * byte of pat matched at goes to pos unless it is NULL. */
+static int
+acronym(const char *s, size_t len, unsigned long long bounds,
+        const char *pat, size_t plen, int *first, int *last, int *pos)
+{
+	size_t i = 0, j, w;
+	int starts = 0;
+
+	for (j = 0; j < plen; j++) {
+		/* prefer the next word starting with pat[j] */
+		for (w = i; w < len && w < 64; w++)
+			if (ISWORDSTART(bounds, w) && !fstrncmp(&s[w], &pat[j], 1))
+				break;
+		if (w < len && w < 64) {
+			if (!starts++)
+				*first = w;
+			if (pos)
+				pos[j] = w;
+			i = w + 1;
+			continue;
+		}
+		/* otherwise carry on inside the current word */
+		if (!starts)
+			return 0;
+		for (w = i; w < len && !ISWORDSTART(bounds, w); w++)
+			if (!fstrncmp(&s[w], &pat[j], 1))
+				break;
+		if (w >= len || ISWORDSTART(bounds, w))
+			return 0;
+		if (pos)
+			pos[j] = w;
+		i = w + 1;
+	}
+	*last = i - 1;
+	return starts;
+}
+
+/* acronym tier for a single plain input term; it has to enter at least two
+ * words, a single word start followed by letters from anywhere in that word
+ * is a fuzzy match and not an acronym */
+static int
+acronymmatch(struct item *item)
+{
+	const struct term *t = qterms;
+	int first, last;
+
+	if (qtermn != 1 || t->type != TermFuzzy || t->inv
+	|| (t->chars & ~item->chars))
+		return 0;
+	return acronym(item->text + item->mstart, item->mlen, item->bounds,
+	               t->str, t->len, &first, &last, NULL) >= 2;
+}
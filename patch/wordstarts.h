@@ -0,0 +1,6 @@
+#define BOUNDARYBONUS         1.0 /* fuzzy distance taken off per word start hit */
+
+static unsigned long long wordstarts(const char *s, size_t len);
+static int acronym(const char *s, size_t len, unsigned long long bounds,
+                   const char *pat, size_t plen, int *first, int *last, int *pos);
+static int acronymmatch(struct item *item);
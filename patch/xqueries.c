@@ -0,0 +1,217 @@
+#ifdef XCB
+static void
+sendqueries(void)
+{
+	xcb_connection_t *c = XGetXCBConnection(dpy);
+
+	if (embed) {
+		parenttreec = xcb_query_tree(c, parentwin);
+		pendingq |= QueryChildren;
+	}
+	if (parentwin != root) {
+		parentgeomc = xcb_get_geometry(c, parentwin);
+		pendingq |= QueryParent;
+	} else {
+		focusc = xcb_get_input_focus(c);
+		pendingq |= QueryFocus;
+		if (mon < 0) {
+			pointerc = xcb_query_pointer(c, root);
+			pendingq |= QueryPointer;
+		}
+	}
+	xcb_flush(c);
+}
+
+/* forget the replies the menu geometry did not need, the parent's
+ * children are left for watchparent() */
+static void
+dropqueries(void)
+{
+	xcb_connection_t *c = XGetXCBConnection(dpy);
+
+	if (pendingq & QueryParent)
+		xcb_discard_reply(c, parentgeomc.sequence);
+	if (pendingq & QueryFocus)
+		xcb_discard_reply(c, focusc.sequence);
+	if (pendingq & QueryPointer)
+		xcb_discard_reply(c, pointerc.sequence);
+	pendingq &= QueryChildren;
+}
+
+static void
+parentsize(int *w, int *h)
+{
+	xcb_get_geometry_reply_t *g;
+
+	if (!(pendingq & QueryParent)) {
+		/* the root window, as read in main() */
+		*w = parentwa.width;
+		*h = parentwa.height;
+		return;
+	}
+	pendingq &= ~QueryParent;
+	if (!(g = xcb_get_geometry_reply(XGetXCBConnection(dpy), parentgeomc, NULL)))
+		die("could not get embedding window attributes: 0x%lx", parentwin);
+	*w = g->width;
+	*h = g->height;
+	free(g);
+}
+
+static void
+watchparent(void)
+{
+	xcb_query_tree_reply_t *t;
+	xcb_window_t *children;
+	int i, n;
+
+	XSelectInput(dpy, parentwin, FocusChangeMask | SubstructureNotifyMask);
+	if (!(pendingq & QueryChildren))
+		return;
+	pendingq &= ~QueryChildren;
+	if (!(t = xcb_query_tree_reply(XGetXCBConnection(dpy), parenttreec, NULL)))
+		return;
+	/* asked for before win existed, so these are all below it */
+	children = xcb_query_tree_children(t);
+	n = xcb_query_tree_children_length(t);
+	for (i = 0; i < n; i++)
+		XSelectInput(dpy, children[i], FocusChangeMask);
+	free(t);
+}
+
+#ifdef XINERAMA
+/* geometry of the top-level window containing the input focus */
+static int
+focusrect(int *x, int *y, int *w, int *h)
+{
+	xcb_connection_t *c = XGetXCBConnection(dpy);
+	xcb_get_input_focus_reply_t *f;
+	xcb_query_tree_reply_t *t;
+	xcb_get_geometry_cookie_t gc;
+	xcb_get_geometry_reply_t *g;
+	xcb_window_t fw, parent;
+
+	if (!(pendingq & QueryFocus))
+		return 0;
+	pendingq &= ~QueryFocus;
+	if (!(f = xcb_get_input_focus_reply(c, focusc, NULL)))
+		return 0;
+	fw = f->focus;
+	free(f);
+	if (fw == root || fw == PointerRoot || fw == None)
+		return 0;
+	/* each window's geometry is asked for along with its parent, so the
+	 * top-level one has arrived by the time the walk ends there */
+	for (;;) {
+		gc = xcb_get_geometry(c, fw);
+		if (!(t = xcb_query_tree_reply(c, xcb_query_tree(c, fw), NULL)))
+			break;
+		parent = t->parent;
+		free(t);
+		if (parent == root || parent == fw)
+			break;
+		xcb_discard_reply(c, gc.sequence);
+		fw = parent;
+	}
+	if (!(g = xcb_get_geometry_reply(c, gc, NULL)))
+		return 0;
+	*x = g->x;
+	*y = g->y;
+	*w = g->width;
+	*h = g->height;
+	free(g);
+	return 1;
+}
+
+static int
+pointerpos(int *x, int *y)
+{
+	xcb_query_pointer_reply_t *p;
+
+	if (!(pendingq & QueryPointer))
+		return 0;
+	pendingq &= ~QueryPointer;
+	if (!(p = xcb_query_pointer_reply(XGetXCBConnection(dpy), pointerc, NULL)))
+		return 0;
+	*x = p->root_x;
+	*y = p->root_y;
+	free(p);
+	return 1;
+}
+#endif
+#else
+static void
+sendqueries(void)
+{
+}
+
+static void
+dropqueries(void)
+{
+}
+
+static void
+parentsize(int *w, int *h)
+{
+	XWindowAttributes wa;
+
+	/* the root window was read in main(), an embedding parent may have
+	 * been resized while stdin was read */
+	if (parentwin == root)
+		wa = parentwa;
+	else if (!XGetWindowAttributes(dpy, parentwin, &wa))
+		die("could not get embedding window attributes: 0x%lx", parentwin);
+	*w = wa.width;
+	*h = wa.height;
+}
+
+static void
+watchparent(void)
+{
+	Window w, dw, *dws;
+	unsigned int i, du;
+
+	XSelectInput(dpy, parentwin, FocusChangeMask | SubstructureNotifyMask);
+	if (XQueryTree(dpy, parentwin, &dw, &w, &dws, &du) && dws) {
+		for (i = 0; i < du && dws[i] != win; ++i)
+			XSelectInput(dpy, dws[i], FocusChangeMask);
+		XFree(dws);
+	}
+}
+
+#ifdef XINERAMA
+/* geometry of the top-level window containing the input focus */
+static int
+focusrect(int *x, int *y, int *w, int *h)
+{
+	Window fw, pw, dw, *dws;
+	XWindowAttributes wa;
+	unsigned int du;
+	int di;
+
+	XGetInputFocus(dpy, &fw, &di);
+	if (fw == root || fw == PointerRoot || fw == None)
+		return 0;
+	do {
+		if (XQueryTree(dpy, (pw = fw), &dw, &fw, &dws, &du) && dws)
+			XFree(dws);
+	} while (fw != root && fw != pw);
+	if (!XGetWindowAttributes(dpy, pw, &wa))
+		return 0;
+	*x = wa.x;
+	*y = wa.y;
+	*w = wa.width;
+	*h = wa.height;
+	return 1;
+}
+
+static int
+pointerpos(int *x, int *y)
+{
+	Window dw;
+	unsigned int du;
+	int di;
+
+	return XQueryPointer(dpy, root, &dw, &dw, x, y, &di, &di, &du);
+}
+#endif
+#endif
@@ -0,0 +1,19 @@
+/* Queries setup() makes after the ingest wait. Built with XCB they are all
+ * sent up front and share round-trips, with plain Xlib each one waits. */
+#ifdef XCB
+static xcb_get_geometry_cookie_t parentgeomc;
+static xcb_query_tree_cookie_t parenttreec;
+static xcb_get_input_focus_cookie_t focusc;
+static xcb_query_pointer_cookie_t pointerc;
+static int pendingq; /* QueryParent... bits of the cookies not yet read */
+enum { QueryParent = 1, QueryChildren = 2, QueryFocus = 4, QueryPointer = 8 };
+#endif
+
+static void sendqueries(void);
+static void dropqueries(void);
+static void parentsize(int *w, int *h);
+static void watchparent(void);
+#ifdef XINERAMA
+static int focusrect(int *x, int *y, int *w, int *h);
+static int pointerpos(int *x, int *y);
+#endif
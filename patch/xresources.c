@@ -1,70 +1,71 @@
 #include <X11/Xresource.h>
 
+/* the strings picked from it point into the database, so it is kept
+ * until cleanup() */
+static XrmDatabase xdb;
+
 void
 readxresources(void)
 {
 	XrmInitialize();
 
 	char* xrm;
-	if ((xrm = XResourceManagerString(drw->dpy))) {
+	if ((xrm = XResourceManagerString(dpy))) {
 		char *type;
-		XrmDatabase xdb = XrmGetStringDatabase(xrm);
 		XrmValue xval;
 
+		xdb = XrmGetStringDatabase(xrm);
 		if (XrmGetResource(xdb, "dmenu.font", "*", &type, &xval))
-			fonts[0] = strdup(xval.addr);
-		else
-			fonts[0] = strdup(fonts[0]);
+			fonts[0] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.background", "*", &type, &xval))
-			colors[SchemeNorm][ColBg] = strdup(xval.addr);
+			colors[SchemeNorm][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.foreground", "*", &type, &xval))
-			colors[SchemeNorm][ColFg] = strdup(xval.addr);
+			colors[SchemeNorm][ColFg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.selbackground", "*", &type, &xval))
-			colors[SchemeSel][ColBg] = strdup(xval.addr);
+			colors[SchemeSel][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.selforeground", "*", &type, &xval))
-			colors[SchemeSel][ColFg] = strdup(xval.addr);
+			colors[SchemeSel][ColFg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.outbackground", "*", &type, &xval))
-			colors[SchemeOut][ColBg] = strdup(xval.addr);
+			colors[SchemeOut][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.outforeground", "*", &type, &xval))
-			colors[SchemeOut][ColFg] = strdup(xval.addr);
+			colors[SchemeOut][ColFg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.bordercolor", "*", &type, &xval))
-			colors[SchemeBorder][ColBg] = strdup(xval.addr);
+			colors[SchemeBorder][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.selhlbackground", "*", &type, &xval))
-			colors[SchemeSelHighlight][ColBg] = strdup(xval.addr);
+			colors[SchemeSelHighlight][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.selhlforeground", "*", &type, &xval))
-			colors[SchemeSelHighlight][ColFg] = strdup(xval.addr);
+			colors[SchemeSelHighlight][ColFg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.hlbackground", "*", &type, &xval))
-			colors[SchemeNormHighlight][ColBg] = strdup(xval.addr);
+			colors[SchemeNormHighlight][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.hlforeground", "*", &type, &xval))
-			colors[SchemeNormHighlight][ColFg] = strdup(xval.addr);
+			colors[SchemeNormHighlight][ColFg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.hpbackground", "*", &type, &xval))
-			colors[SchemeHp][ColBg] = strdup(xval.addr);
+			colors[SchemeHp][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.hpforeground", "*", &type, &xval))
-			colors[SchemeHp][ColFg] = strdup(xval.addr);
+			colors[SchemeHp][ColFg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.hoverbackground", "*", &type, &xval))
-			colors[SchemeHover][ColBg] = strdup(xval.addr);
+			colors[SchemeHover][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.hoverforeground", "*", &type, &xval))
-			colors[SchemeHover][ColFg] = strdup(xval.addr);
+			colors[SchemeHover][ColFg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.greenbackground", "*", &type, &xval))
-			colors[SchemeGreen][ColBg] = strdup(xval.addr);
+			colors[SchemeGreen][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.greenforeground", "*", &type, &xval))
-			colors[SchemeGreen][ColFg] = strdup(xval.addr);
+			colors[SchemeGreen][ColFg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.yellowbackground", "*", &type, &xval))
-			colors[SchemeYellow][ColBg] = strdup(xval.addr);
+			colors[SchemeYellow][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.yellowforeground", "*", &type, &xval))
-			colors[SchemeYellow][ColFg] = strdup(xval.addr);
+			colors[SchemeYellow][ColFg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.bluebackground", "*", &type, &xval))
-			colors[SchemeBlue][ColBg] = strdup(xval.addr);
+			colors[SchemeBlue][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.blueforeground", "*", &type, &xval))
-			colors[SchemeBlue][ColFg] = strdup(xval.addr);
+			colors[SchemeBlue][ColFg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.purplebackground", "*", &type, &xval))
-			colors[SchemePurple][ColBg] = strdup(xval.addr);
+			colors[SchemePurple][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.purpleforeground", "*", &type, &xval))
-			colors[SchemePurple][ColFg] = strdup(xval.addr);
+			colors[SchemePurple][ColFg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.redbackground", "*", &type, &xval))
-			colors[SchemeRed][ColBg] = strdup(xval.addr);
+			colors[SchemeRed][ColBg] = xval.addr;
 		if (XrmGetResource(xdb, "dmenu.redforeground", "*", &type, &xval))
-			colors[SchemeRed][ColFg] = strdup(xval.addr);
-		XrmDestroyDatabase(xdb);
+			colors[SchemeRed][ColFg] = xval.addr;
 	}
 }